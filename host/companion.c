@@ -0,0 +1,695 @@
+#include <pebble.h>
+#include "companion.h"
+#include "message_protocol.h"
+#include "codec.h"
+#include "events.h"
+#include "shim.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+#define DEFAULT_WATCH_INBOX 124 //Inbox size assumed until the watch reports its own
+#define MAX_MESSAGE_SIZE 1024 //Largest message the stand-in builds
+#define MAX_RECORD_SIZE 80 //Largest packed event record, with a full length title
+#define HOUR 3600
+//Event list message bytes outside the event records: the dictionary count,
+//message code tuple and list tuple header, then the payload version, base
+//time record and list header
+#define LIST_MESSAGE_OVERHEAD (1 + sizeof(Tuple) + sizeof(int32_t) + sizeof(Tuple) + 1 + 4 + 3)
+#define SUBSCRIBABLE_TYPES (((1 << NUM_UPDATE_TYPES) - 1) & ~(1 << UPDATE_TYPE_PEBBLE_STATS))
+
+//----------COMPANION DATA STRUCTURES----------
+//An event stored on the phone
+typedef struct{
+  bool used;
+  uint32_t id;
+  time_t start;
+  uint32_t duration;
+  uint32_t color;//24 bit RGB
+  char title[CODEC_MAX_STRING];
+} PhoneEvent;
+
+//A message waiting to reach the watch
+typedef struct{
+  bool eventList;//true if the message holds part of an event list
+  uint32_t size;
+  uint8_t data[];
+} PendingMessage;
+
+//A send failure recorded in a replayed trace
+typedef struct{
+  uint64_t timeMs;//simulated time of the failed send
+  AppMessageResult result;
+} ReplayFault;
+
+//Writing position within a packed payload. Sizes keep counting past the
+//capacity, so an overflow can be detected once writing is done.
+typedef struct{
+  uint8_t * data;
+  uint16_t size;
+  uint16_t capacity;
+} PayloadWriter;
+
+//----------LOCAL VARIABLES----------
+static uint32_t latency = DEFAULT_PHONE_LATENCY;
+static uint32_t linkDelay = DEFAULT_LINK_DELAY;
+static uint64_t linkFreeMs = 0;//time the connection is free for the next phone message
+static AppMessageResult injectedFault = APP_MSG_OK;
+static uint32_t injectedFaults = 0;//watch messages left to fail with injectedFault
+static bool packed = true;
+static bool subscriptionsEnabled = true;
+static uint8_t subscribedTypes = 0;
+static uint32_t watchInboxSize = DEFAULT_WATCH_INBOX;
+static CompanionStats stats;
+
+static uint8_t batteryPercent = 76;
+static bool batteryCharging = false;
+static char infoText[CODEC_MAX_STRING] = "Host harness";
+static int32_t temperature = 18;
+static uint32_t weatherCondition = 800;
+static PhoneEvent events[NUM_EVENTS];
+static bool eventsChanged = true;//true until the current events are sent
+static bool hashKnown = false;//true once the watch's hash of the current events is known
+static uint32_t syncedHash = 0;
+
+static bool replaying = false;
+static ReplayFault * replayFaults = NULL;
+static uint32_t numReplayFaults = 0;
+static uint32_t nextReplayFault = 0;
+
+static uint8_t messageBuffer[MAX_MESSAGE_SIZE];
+
+//----------STATIC FUNCTION DECLARATIONS----------
+static ShimSendOutcome receive(const uint8_t * data, uint32_t size);
+  //Receives a message sent by the watch
+static AppMessageResult next_fault();
+  //Gets the fault to inject into the next watch message
+static void handle_message(const DictionaryIterator * iterator);
+  //Answers a message from the watch
+static bool find_int(const DictionaryIterator * iterator, uint32_t key, int32_t * value);
+  //Reads an integer from a watch message
+static void answer_event_request(uint32_t watchHash, uint32_t delay);
+  //Answers an event request
+static void send_response(UpdateType type, uint32_t delay);
+  //Sends the current value of an update type
+static void send_events(uint32_t delay);
+  //Sends every event
+static void send_event_list(uint32_t delay);
+  //Sends every event as a packed event list
+static void send_code(AndroidMessageCode code, uint32_t delay);
+  //Sends a message holding only a message code
+static void send_subscription_ack(uint8_t types, uint32_t delay);
+  //Acknowledges a subscription
+static DictionaryIterator begin_message(AndroidMessageCode code);
+  //Starts building a message
+static void send_message(DictionaryIterator * iterator, bool eventList, uint32_t delay);
+  //Sends a built message over the simulated connection
+static void deliver_message(void * data);
+  //Hands a message to the watch
+static void push_if_subscribed(UpdateType type);
+  //Pushes a changed value if the watch subscribed to it
+static void reconnect(void * data);
+  //Reconnects the phone
+static void replay_message(void * data);
+  //Sends a message recorded in a replayed trace
+static void write_byte(PayloadWriter * writer, uint8_t byte);
+  //Appends one byte to a payload
+
+//----------PAYLOAD WRITERS----------
+//Each writer encodes one value of the encoding it's named for, the
+//inverse of the codec.c readers.
+static void write_CODEC_U8(PayloadWriter * writer, uint8_t value){
+  write_byte(writer, value);
+}
+
+static void write_CODEC_U32(PayloadWriter * writer, uint32_t value){
+  for(int i = 0; i < 4; i++)write_byte(writer, value >> (8 * i));
+}
+
+static void write_CODEC_VARINT(PayloadWriter * writer, uint32_t value){
+  while(value >= 0x80){
+    write_byte(writer, (value & 0x7F) | 0x80);
+    value >>= 7;
+  }
+  write_byte(writer, value);
+}
+
+static void write_CODEC_SVARINT(PayloadWriter * writer, int32_t value){
+  write_CODEC_VARINT(writer, ((uint32_t) value << 1) ^ (uint32_t)(value >> 31));
+}
+
+static void write_CODEC_COLOR(PayloadWriter * writer, GColor value){
+  write_byte(writer, value.argb);
+}
+
+static void write_CODEC_STRING(PayloadWriter * writer, const char * value){
+  size_t length = strnlen(value, CODEC_MAX_STRING - 1);
+  write_byte(writer, length);
+  for(size_t i = 0; i < length; i++)write_byte(writer, value[i]);
+}
+
+//Writes one schema field from a record
+#define PAYLOAD_WRITE_FIELD(encoding, name) write_##encoding(writer, record->name);
+
+//Defines a function that writes a record using a schema
+#define PAYLOAD_RECORD_WRITER(functionName, recordType, schema) \
+  static void functionName(PayloadWriter * writer, const recordType * record){ \
+    schema(PAYLOAD_WRITE_FIELD) \
+  }
+
+PAYLOAD_RECORD_WRITER(write_event_base, CodecEventBase, CODEC_EVENT_BASE_SCHEMA)
+PAYLOAD_RECORD_WRITER(write_event, CodecEvent, CODEC_EVENT_SCHEMA)
+PAYLOAD_RECORD_WRITER(write_event_list, CodecEventList, CODEC_EVENT_LIST_SCHEMA)
+PAYLOAD_RECORD_WRITER(write_weather, CodecWeather, CODEC_WEATHER_SCHEMA)
+PAYLOAD_RECORD_WRITER(write_battery, CodecBattery, CODEC_BATTERY_SCHEMA)
+
+//----------PUBLIC FUNCTIONS----------
+//Connects the companion stand-in to the shim
+void companion_init(){
+  static const ShimPhone phone = {receive};
+  shim_set_phone(&phone);
+  memset(&stats, 0, sizeof(stats));
+  time_t now = time(NULL);
+  companion_set_event(0, 1, now + 30 * 60, 15 * 60, 0x00AAFF, "Standup");
+  companion_set_event(1, 2, now + 3 * HOUR, HOUR, 0xFF5500, "Design review");
+  //The watch doesn't request anything until the companion app makes contact
+  send_code(CODE_PEBBLE_STATS_REQUEST, latency);
+}
+
+//Frees any replayed trace data
+void companion_deinit(){
+  free(replayFaults);
+  replayFaults = NULL;
+  numReplayFaults = 0;
+  nextReplayFault = 0;
+}
+
+//Sets how long the phone takes to start answering a request
+void companion_set_latency(uint32_t milliseconds){
+  latency = milliseconds;
+}
+
+//Sets how long each message takes to cross the connection
+void companion_set_link_delay(uint32_t milliseconds){
+  linkDelay = milliseconds;
+}
+
+//Fails the next watch messages with a given AppMessageResult
+void companion_inject_failures(AppMessageResult result, uint32_t count){
+  injectedFault = result;
+  injectedFaults = count;
+}
+
+//Disconnects the phone
+void companion_disconnect(uint32_t milliseconds){
+  subscribedTypes = 0;
+  shim_set_connected(false);
+  shim_schedule(milliseconds, reconnect, NULL);
+}
+
+//Chooses between packed and legacy responses
+void companion_set_packed(bool newPacked){
+  packed = newPacked;
+}
+
+//Chooses whether the phone accepts subscriptions
+void companion_set_subscriptions(bool enabled){
+  subscriptionsEnabled = enabled;
+  if(!enabled)subscribedTypes = 0;
+}
+
+//Sets the phone battery state
+void companion_set_battery(uint8_t percent, bool charging){
+  batteryPercent = percent;
+  batteryCharging = charging;
+  push_if_subscribed(UPDATE_TYPE_BATTERY);
+}
+
+//Sets the infoText string
+void companion_set_infotext(const char * text){
+  strncpy(infoText, text, sizeof(infoText) - 1);
+  push_if_subscribed(UPDATE_TYPE_INFOTEXT);
+}
+
+//Sets the current weather
+void companion_set_weather(int32_t newTemperature, uint32_t condition){
+  temperature = newTemperature;
+  weatherCondition = condition;
+  push_if_subscribed(UPDATE_TYPE_WEATHER);
+}
+
+//Sets an event
+void companion_set_event(int slot, uint32_t id, time_t start, uint32_t duration,
+                         uint32_t color, const char * title){
+  if(slot < 0 || slot >= NUM_EVENTS)return;
+  PhoneEvent * event = &events[slot];
+  event->used = true;
+  event->id = id;
+  event->start = start;
+  event->duration = duration;
+  event->color = color;
+  strncpy(event->title, title, sizeof(event->title) - 1);
+  eventsChanged = true;
+  push_if_subscribed(UPDATE_TYPE_EVENT);
+}
+
+//Removes an event
+void companion_clear_event(int slot){
+  if(slot < 0 || slot >= NUM_EVENTS || !events[slot].used)return;
+  events[slot].used = false;
+  eventsChanged = true;
+  push_if_subscribed(UPDATE_TYPE_EVENT);
+}
+
+//Sends a response for an update type without being asked
+void companion_push(UpdateType type){
+  send_response(type, 0);
+}
+
+//Sends a new update frequency in a settings update
+void companion_send_update_freq(UpdateType type, int32_t seconds){
+  DictionaryIterator iterator = begin_message(CODE_SETTINGS_UPDATE);
+  dict_write_int32(&iterator, KEY_UPDATE_FREQS_BEGIN + type, seconds);
+  send_message(&iterator, false, 0);
+}
+
+//Replays the phone side of a recorded trace
+int64_t companion_replay(const char * path, TraceStats * baseline){
+  FILE * file = fopen(path, "r");
+  if(file == NULL)return -1;
+  companion_deinit();
+  trace_stats_init(baseline);
+  uint64_t start = shim_now_ms();
+  int64_t lastSend = 0;
+  bool sendingEvents = false;//true after an event response, until the next request
+  char text[256];
+  TraceLine line;
+  while(fgets(text, sizeof(text), file) != NULL){
+    if(!trace_parse_line(text, &line))continue;
+    trace_stats_add(baseline, &line);
+    int64_t offset = trace_stats_duration(baseline);
+    switch(line.event){
+      case 's':
+        lastSend = offset;
+        break;
+      case 'f':
+        //Failures are reported after the send, so they apply to the last send
+        if(line.numValues < 2)break;
+        replayFaults = realloc(replayFaults, (numReplayFaults + 1) * sizeof(ReplayFault));
+        replayFaults[numReplayFaults].timeMs = start + lastSend;
+        replayFaults[numReplayFaults].result = line.values[1];
+        numReplayFaults++;
+        break;
+      case 'Q':
+        sendingEvents = false;
+        break;
+      case 'R':{
+        if(line.numValues < 1)break;
+        //Every event is sent with the first event response to a request
+        bool eventResponse = line.values[0] != CODE_EVENTS_UNCHANGED &&
+          response_type(line.values[0]) == UPDATE_TYPE_EVENT;
+        if(!eventResponse || !sendingEvents)
+          shim_schedule(offset, replay_message, (void *)(intptr_t) line.values[0]);
+        if(eventResponse)sendingEvents = true;
+        break;
+      }
+    }
+  }
+  fclose(file);
+  replaying = true;
+  return trace_stats_duration(baseline);
+}
+
+//Ends a replay
+void companion_end_replay(){
+  replaying = false;
+}
+
+//Gets the messages the companion stand-in has handled
+const CompanionStats * companion_get_stats(){
+  return &stats;
+}
+
+//----------STATIC FUNCTIONS----------
+
+/**
+*Receives a message sent by the watch, answering it after the phone latency
+*@param data the message dictionary
+*@param size the dictionary size in bytes
+*@return APP_MSG_OK after a round trip, or an injected fault
+*/
+static ShimSendOutcome receive(const uint8_t * data, uint32_t size){
+  AppMessageResult fault = next_fault();
+  if(fault != APP_MSG_OK){
+    stats.rejected++;
+    //Lost messages are only noticed once the watch stops waiting for an ack
+    return (ShimSendOutcome){fault, fault == APP_MSG_SEND_TIMEOUT ? ACK_TIMEOUT : linkDelay};
+  }
+  stats.received++;
+  DictionaryIterator iterator;
+  dict_read_begin_from_buffer(&iterator, data, size);
+  handle_message(&iterator);
+  return (ShimSendOutcome){APP_MSG_OK, 2 * linkDelay};
+}
+
+/**
+*Gets the fault to inject into the next watch message. Replayed faults
+*apply to the first message sent at or after their recorded time.
+*@return the AppMessageResult to fail with, or APP_MSG_OK
+*/
+static AppMessageResult next_fault(){
+  if(nextReplayFault < numReplayFaults &&
+     replayFaults[nextReplayFault].timeMs <= shim_now_ms()){
+    return replayFaults[nextReplayFault++].result;
+  }
+  if(injectedFaults > 0){
+    injectedFaults--;
+    return injectedFault;
+  }
+  return APP_MSG_OK;
+}
+
+/**
+*Answers a message from the watch. While replaying, only the recorded
+*phone messages are sent.
+*@param iterator the received message
+*/
+static void handle_message(const DictionaryIterator * iterator){
+  int32_t code;
+  int32_t value;
+  if(!find_int(iterator, KEY_MESSAGE_CODE, &code))return;
+  switch((PebbleMessageCode) code){
+    case CODE_UPDATE_REQUEST:{
+      stats.requests++;
+      if(find_int(iterator, KEY_INBOX_SIZE, &value))watchInboxSize = value;
+      int32_t types = 0;
+      find_int(iterator, KEY_REQUEST_TYPES, &types);
+      if(replaying)break;
+      if(types & (1 << UPDATE_TYPE_EVENT)){
+        int32_t hash = 0;
+        find_int(iterator, KEY_EVENT_SET_HASH, &hash);
+        answer_event_request(hash, latency);
+      }
+      for(int i = UPDATE_TYPE_BATTERY; i <= UPDATE_TYPE_WEATHER; i++){
+        if(types & (1 << i))send_response(i, latency);
+      }
+      break;
+    }
+    case CODE_SUBSCRIBE:
+      if(replaying || !subscriptionsEnabled || !find_int(iterator, KEY_SUBSCRIBED_TYPES, &value))
+        break;
+      subscribedTypes = value & SUBSCRIBABLE_TYPES;
+      send_subscription_ack(subscribedTypes, latency);
+      break;
+    case CODE_PEBBLE_STATS_RESPONSE:
+      if(dict_find(iterator, KEY_METRICS) != NULL)stats.metrics++;
+      break;
+    default:
+      //The watch no longer sends the single type request codes
+      break;
+  }
+}
+
+/**
+*Reads an integer from a watch message
+*@param iterator the received message
+*@param key the message key
+*@param value set to the integer, if found
+*@return true if the message held the key, false otherwise
+*/
+static bool find_int(const DictionaryIterator * iterator, uint32_t key, int32_t * value){
+  Tuple * tuple = dict_find(iterator, key);
+  if(tuple == NULL)return false;
+  *value = tuple->value->int32;
+  return true;
+}
+
+/**
+*Answers an event request. The watch's hash of the events is only known
+*once it has applied them, so the first request after the events are sent
+*provides the hash later requests are checked against.
+*@param watchHash the event set hash sent by the watch
+*@param delay milliseconds until the answer is sent
+*/
+static void answer_event_request(uint32_t watchHash, uint32_t delay){
+  if(!eventsChanged && (!hashKnown || watchHash == syncedHash)){
+    syncedHash = watchHash;
+    hashKnown = true;
+    send_code(CODE_EVENTS_UNCHANGED, delay);
+    return;
+  }
+  send_events(delay);
+}
+
+/**
+*Sends the current value of an update type
+*@param type the update type
+*@param delay milliseconds until the response is sent
+*/
+static void send_response(UpdateType type, uint32_t delay){
+  uint8_t payload[16];
+  PayloadWriter writer = {payload, 0, sizeof(payload)};
+  DictionaryIterator iterator;
+  switch(type){
+    case UPDATE_TYPE_EVENT:
+      send_events(delay);
+      return;
+    case UPDATE_TYPE_BATTERY:
+      iterator = begin_message(CODE_BATTERY_RESPONSE);
+      if(packed){
+        CodecBattery battery = {batteryPercent, batteryCharging};
+        write_CODEC_U8(&writer, CODEC_VERSION);
+        write_battery(&writer, &battery);
+        dict_write_data(&iterator, KEY_PACKED_BATTERY, payload, writer.size);
+      }else{
+        char battery[6];
+        snprintf(battery, sizeof(battery), "%d%s", batteryPercent, batteryCharging ? "+" : "");
+        dict_write_cstring(&iterator, KEY_BATTERY_UPDATE, battery);
+      }
+      break;
+    case UPDATE_TYPE_INFOTEXT:
+      iterator = begin_message(CODE_INFOTEXT_RESPONSE);
+      dict_write_cstring(&iterator, KEY_INFOTEXT, infoText);
+      break;
+    case UPDATE_TYPE_WEATHER:
+      iterator = begin_message(CODE_WEATHER_RESPONSE);
+      if(packed){
+        CodecWeather weather = {temperature, weatherCondition};
+        write_CODEC_U8(&writer, CODEC_VERSION);
+        write_weather(&writer, &weather);
+        dict_write_data(&iterator, KEY_PACKED_WEATHER, payload, writer.size);
+      }else{
+        dict_write_int32(&iterator, KEY_TEMPERATURE, temperature);
+        dict_write_int32(&iterator, KEY_WEATHER_COND, weatherCondition);
+      }
+      break;
+    default:
+      return;
+  }
+  send_message(&iterator, false, delay);
+}
+
+/**
+*Sends every event. Packed events are sent as a full event list, and
+*legacy events as one message per event, with removed events deleted.
+*@param delay milliseconds until the first message is sent
+*/
+static void send_events(uint32_t delay){
+  eventsChanged = false;
+  hashKnown = false;
+  if(packed){
+    send_event_list(delay);
+    return;
+  }
+  for(int i = 0; i < NUM_EVENTS; i++){
+    PhoneEvent * event = &events[i];
+    DictionaryIterator iterator;
+    if(event->used){
+      char color[7];
+      snprintf(color, sizeof(color), "%06X", (unsigned) event->color);
+      iterator = begin_message(CODE_EVENT_RESPONSE);
+      dict_write_cstring(&iterator, KEY_EVENT_TITLE, event->title);
+      dict_write_int32(&iterator, KEY_EVENT_START, event->start);
+      dict_write_int32(&iterator, KEY_EVENT_END, event->start + event->duration);
+      dict_write_cstring(&iterator, KEY_EVENT_COLOR, color);
+      dict_write_int32(&iterator, KEY_EVENT_NUM, i);
+      dict_write_int32(&iterator, KEY_EVENT_ID, event->id);
+    }else if(event->id != 0){
+      iterator = begin_message(CODE_EVENT_DELETE);
+      dict_write_int32(&iterator, KEY_EVENT_ID, event->id);
+    }else continue;
+    send_message(&iterator, true, delay);
+  }
+}
+
+/**
+*Sends every event as a packed event list, split into as few parts as
+*fit the watch inbox. Event starts are relative to the start of the hour.
+*@param delay milliseconds until the first part is sent
+*/
+static void send_event_list(uint32_t delay){
+  time_t now = time(NULL);
+  CodecEventBase base = {now - now % HOUR};
+  uint8_t records[NUM_EVENTS][MAX_RECORD_SIZE];
+  uint16_t recordSizes[NUM_EVENTS];
+  int numRecords = 0;
+  for(int i = 0; i < NUM_EVENTS; i++){
+    PhoneEvent * event = &events[i];
+    if(!event->used)continue;
+    CodecEvent record = {
+      .num = i,
+      .id = event->id,
+      .start = event->start - base.base,
+      .duration = event->duration,
+      .color = GColorFromHEX(event->color)
+    };
+    strncpy(record.title, event->title, sizeof(record.title));
+    PayloadWriter writer = {records[numRecords], 0, MAX_RECORD_SIZE};
+    write_event(&writer, &record);
+    recordSizes[numRecords++] = writer.size;
+  }
+  //Each part holds at least one record, so an oversized record is sent alone
+  uint32_t messageSize = watchInboxSize < MAX_MESSAGE_SIZE ? watchInboxSize : MAX_MESSAGE_SIZE;
+  uint32_t capacity = messageSize > LIST_MESSAGE_OVERHEAD ? messageSize - LIST_MESSAGE_OVERHEAD : 0;
+  int partStarts[NUM_EVENTS + 1];
+  int numParts = 0;
+  uint32_t partSize = capacity;
+  for(int i = 0; i < numRecords; i++){
+    if(partSize + recordSizes[i] > capacity){
+      partStarts[numParts++] = i;
+      partSize = 0;
+    }
+    partSize += recordSizes[i];
+  }
+  if(numParts == 0)partStarts[numParts++] = 0;//An empty list still clears every slot
+  partStarts[numParts] = numRecords;
+  for(int part = 0; part < numParts; part++){
+    uint8_t payload[MAX_MESSAGE_SIZE];
+    PayloadWriter writer = {payload, 0, sizeof(payload)};
+    CodecEventList header = {part, numParts, partStarts[part + 1] - partStarts[part]};
+    write_CODEC_U8(&writer, CODEC_VERSION);
+    write_event_base(&writer, &base);
+    write_event_list(&writer, &header);
+    for(int i = partStarts[part]; i < partStarts[part + 1]; i++){
+      for(int j = 0; j < recordSizes[i]; j++)write_byte(&writer, records[i][j]);
+    }
+    DictionaryIterator iterator = begin_message(CODE_EVENT_LIST_RESPONSE);
+    dict_write_data(&iterator, KEY_PACKED_EVENT_LIST, payload, writer.size);
+    send_message(&iterator, true, delay);
+  }
+}
+
+/**
+*Sends a message holding only a message code
+*@param code the message code
+*@param delay milliseconds until the message is sent
+*/
+static void send_code(AndroidMessageCode code, uint32_t delay){
+  DictionaryIterator iterator = begin_message(code);
+  send_message(&iterator, false, delay);
+}
+
+/**
+*Acknowledges a subscription
+*@param types the update types the phone will push
+*@param delay milliseconds until the acknowledgement is sent
+*/
+static void send_subscription_ack(uint8_t types, uint32_t delay){
+  DictionaryIterator iterator = begin_message(CODE_SUBSCRIPTION_ACK);
+  dict_write_int32(&iterator, KEY_SUBSCRIBED_TYPES, types);
+  send_message(&iterator, false, delay);
+}
+
+/**
+*Starts building a message in the shared message buffer
+*@param code the message code
+*@return the dictionary iterator to write the message with
+*/
+static DictionaryIterator begin_message(AndroidMessageCode code){
+  DictionaryIterator iterator;
+  dict_write_begin(&iterator, messageBuffer, sizeof(messageBuffer));
+  dict_write_int32(&iterator, KEY_MESSAGE_CODE, code);
+  return iterator;
+}
+
+/**
+*Sends a built message over the simulated connection. The phone sends one
+*message at a time, so each message waits for the one before it.
+*@param iterator the message iterator
+*@param eventList true if the message carries events
+*@param delay milliseconds until the message is sent
+*/
+static void send_message(DictionaryIterator * iterator, bool eventList, uint32_t delay){
+  uint32_t size = dict_write_end(iterator);
+  PendingMessage * message = malloc(sizeof(PendingMessage) + size);
+  message->eventList = eventList;
+  message->size = size;
+  memcpy(message->data, messageBuffer, size);
+  uint64_t now = shim_now_ms();
+  uint64_t sendTime = now + delay > linkFreeMs ? now + delay : linkFreeMs;
+  linkFreeMs = sendTime + linkDelay;
+  shim_schedule(sendTime + linkDelay - now, deliver_message, message);
+}
+
+/**
+*Hands a message to the watch. Events that don't arrive are sent again
+*with the next event request.
+*@param data the PendingMessage
+*/
+static void deliver_message(void * data){
+  PendingMessage * message = data;
+  if(shim_deliver(message->data, message->size) == APP_MSG_OK){
+    stats.sent++;
+    stats.bytesSent += message->size;
+  }else{
+    stats.undelivered++;
+    if(message->eventList)eventsChanged = true;
+  }
+  free(message);
+}
+
+/**
+*Pushes a changed value if the watch subscribed to its update type
+*@param type the changed update type
+*/
+static void push_if_subscribed(UpdateType type){
+  if(!replaying && (subscribedTypes & (1 << type)))send_response(type, latency);
+}
+
+/**
+*Reconnects the phone after companion_disconnect
+*@param data unused
+*/
+static void reconnect(void * data){
+  shim_set_connected(true);
+}
+
+/**
+*Sends a message recorded in a replayed trace, using the current phone data
+*for its contents. Color and settings updates aren't recorded in traces, so
+*they can't be replayed.
+*@param data the AndroidMessageCode
+*/
+static void replay_message(void * data){
+  AndroidMessageCode code = (intptr_t) data;
+  switch(code){
+    case CODE_EVENTS_UNCHANGED:
+    case CODE_PEBBLE_STATS_REQUEST:
+      send_code(code, 0);
+      break;
+    case CODE_SUBSCRIPTION_ACK:
+      subscribedTypes = SUBSCRIBABLE_TYPES;
+      send_subscription_ack(subscribedTypes, 0);
+      break;
+    default:
+      if(response_type(code) != NUM_UPDATE_TYPES)send_response(response_type(code), 0);
+  }
+}
+
+/**
+*Appends one byte to a payload, if it fits
+*@param writer the payload writer
+*@param byte the byte to write
+*/
+static void write_byte(PayloadWriter * writer, uint8_t byte){
+  if(writer->size < writer->capacity)writer->data[writer->size] = byte;
+  writer->size++;
+}
@@ -0,0 +1,148 @@
+/**
+*@File companion.h
+*Stand-in for the Android companion app. It answers watch requests the
+*way the companion app does, pushes changes to subscribed update types,
+*and can inject AppMessage faults or replay the phone side of a recorded
+*trace.
+*/
+#pragma once
+#include <pebble.h>
+#include "message_handler.h"
+#include "trace.h"
+
+#define DEFAULT_PHONE_LATENCY 200 //Milliseconds the phone takes to start answering a request
+#define DEFAULT_LINK_DELAY 50 //Milliseconds each message takes to cross the connection
+#define ACK_TIMEOUT 5000 //Milliseconds before the watch gives up on an unacknowledged message
+
+//Messages the companion stand-in handled
+typedef struct{
+  uint32_t received;//watch messages acknowledged
+  uint32_t rejected;//watch messages failed with an injected fault
+  uint32_t requests;//update requests received
+  uint32_t metrics;//messaging metrics received
+  uint32_t sent;//messages delivered to the watch
+  uint32_t undelivered;//messages the watch dropped or never got
+  uint64_t bytesSent;//bytes of every message delivered to the watch
+} CompanionStats;
+
+/**
+*Connects the companion stand-in to the shim, with default phone data,
+*and contacts the watch
+*/
+void companion_init();
+
+/**
+*Frees any replayed trace data
+*/
+void companion_deinit();
+
+/**
+*Sets how long the phone takes to start answering a request
+*@param milliseconds the response delay
+*/
+void companion_set_latency(uint32_t milliseconds);
+
+/**
+*Sets how long each message takes to cross the connection. Messages from
+*the phone are sent one at a time, so a burst of messages is spread out.
+*@param milliseconds the delay per message
+*/
+void companion_set_link_delay(uint32_t milliseconds);
+
+/**
+*Fails the next watch messages with a given AppMessageResult
+*@param result APP_MSG_BUSY to reject messages, or APP_MSG_SEND_TIMEOUT to
+*never acknowledge them
+*@param count the number of messages to fail
+*/
+void companion_inject_failures(AppMessageResult result, uint32_t count);
+
+/**
+*Disconnects the phone, dropping its subscriptions
+*@param milliseconds time until the phone reconnects
+*/
+void companion_disconnect(uint32_t milliseconds);
+
+/**
+*Chooses between packed and legacy responses
+*@param packed true to send packed codec payloads
+*/
+void companion_set_packed(bool packed);
+
+/**
+*Chooses whether the phone accepts subscriptions
+*@param enabled true to acknowledge subscriptions and push changes
+*/
+void companion_set_subscriptions(bool enabled);
+
+/**
+*Sets the phone battery state, pushing it if subscribed
+*@param percent the charge percentage
+*@param charging true if the phone is charging
+*/
+void companion_set_battery(uint8_t percent, bool charging);
+
+/**
+*Sets the infoText string, pushing it if subscribed
+*@param text the new infoText
+*/
+void companion_set_infotext(const char * text);
+
+/**
+*Sets the current weather, pushing it if subscribed
+*@param temperature the temperature in degrees
+*@param condition the OpenWeatherAPI condition code
+*/
+void companion_set_weather(int32_t temperature, uint32_t condition);
+
+/**
+*Sets an event, pushing the event list if subscribed
+*@param slot the event slot, below NUM_EVENTS
+*@param id the event ID
+*@param start the event start time
+*@param duration seconds from start to end
+*@param color the event color, as a 24 bit RGB value
+*@param title the event title
+*/
+void companion_set_event(int slot, uint32_t id, time_t start, uint32_t duration,
+                         uint32_t color, const char * title);
+
+/**
+*Removes an event, pushing the event list if subscribed
+*@param slot the event slot
+*/
+void companion_clear_event(int slot);
+
+/**
+*Sends a response for an update type without being asked
+*@param type the update type
+*/
+void companion_push(UpdateType type);
+
+/**
+*Sends a new update frequency in a settings update
+*@param type the update type
+*@param seconds the new update frequency
+*/
+void companion_send_update_freq(UpdateType type, int32_t seconds);
+
+/**
+*Replays the phone side of a recorded trace, starting now. Phone messages
+*are sent at their recorded times, and recorded send failures are injected
+*at theirs. Automatic answers are disabled until the replay is finished.
+*@param path the trace file
+*@param baseline set to statistics read from the recorded trace
+*@return the replay length in milliseconds, or -1 if the file can't be read
+*/
+int64_t companion_replay(const char * path, TraceStats * baseline);
+
+/**
+*Ends a replay, turning automatic answers back on
+*/
+void companion_end_replay();
+
+/**
+*Gets the messages the companion stand-in has handled
+*@return the companion statistics
+*/
+const CompanionStats * companion_get_stats();
@@ -0,0 +1,56 @@
+#include <pebble.h>
+#include "display_handler.h"
+#include "display_stub.h"
+
+//----------LOCAL VARIABLES----------
+static uint32_t displayUpdates = 0;
+
+//----------PUBLIC FUNCTIONS----------
+//Gets the number of display updates made by the app
+uint32_t display_stub_updates(){
+  return displayUpdates;
+}
+
+void display_init(){}
+
+void display_deinit(){}
+
+void set_theme(Theme theme){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: theme %d", theme);
+}
+
+void update_event_display(int eventNum, char * event_title,
+                          char * event_time, int eventPercent, GColor event_color){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: event %d \"%s\" \"%s\"", eventNum, event_title, event_time);
+}
+
+void set_time(time_t newTime){}
+
+void update_day_overview(const uint8_t * slots){}
+
+void update_weather(int degrees, int condition){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: weather %d %d", degrees, condition);
+}
+
+void update_colors(char colorArray[][7]){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: colors");
+}
+
+void update_gcolors(GColor colorArray[]){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: colors");
+}
+
+void update_text(char * newText, DisplayTextType textType){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: text %d \"%s\"", textType, newText);
+}
+
+void set_date_format(char * format){
+  displayUpdates++;
+  APP_LOG(APP_LOG_LEVEL_DEBUG, "display: date format \"%s\"", format);
+}
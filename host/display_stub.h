@@ -0,0 +1,13 @@
+/**
+*@File display_stub.h
+*Host stand-in for display_handler.c. Nothing is drawn: display updates
+*are only counted, and logged when verbose logging is on.
+*/
+#pragma once
+#include <pebble.h>
+
+/**
+*Gets the number of display updates made by the app
+*@return display_handler calls since launch
+*/
+uint32_t display_stub_updates();
@@ -0,0 +1,442 @@
+/**
+*@File harness.c
+*Runs the watchface's messaging modules on the host against the AppMessage
+*shim and the companion stand-in, following a script. See README.md for
+*the script commands.
+*/
+#include <pebble.h>
+#include <libgen.h>
+#include <unistd.h>
+#include "events.h"
+#include "forecast.h"
+#include "phone_battery.h"
+#include "message_handler.h"
+#include "util.h"
+#include "display_handler.h"
+#include "display_stub.h"
+#include "companion.h"
+#include "shim.h"
+#include "trace.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+#define START_TIME 1451606400 //Simulated launch time, 2016-01-01 00:00 UTC
+#define START_HOUR 8 //Hour of the first simulated day the app launches at
+#define REPLAY_MARGIN 60000 //Milliseconds to keep running after a replayed trace ends
+#define MAX_LINE 256
+#define MS_PER_MINUTE 60000
+
+//----------HARNESS DATA STRUCTURES----------
+//A value that script expectations and the benchmark report can check
+typedef struct{
+  const char * name;
+  uint64_t (* read)(const TraceStats * stats);
+} Metric;
+
+//----------LOCAL VARIABLES----------
+static bool verbose = false;//print app logs
+static bool printTrace = false;//print trace lines
+static uint32_t activityMinutes = 0;//minutes between simulated wrist movements, or 0 for a still wrist
+static bool moveScheduled = false;//true while simulated wrist movement is scheduled
+static TraceStats current;//statistics from the app's own trace
+static TraceStats baseline;//statistics from the last replayed trace
+static bool hasBaseline = false;
+static uint32_t failedExpectations = 0;
+
+//----------STATIC FUNCTION DECLARATIONS----------
+static void log_line(uint8_t level, const char * message);
+  //Handles one app log line
+static void init_app();
+  //Initializes the app modules in the same order as main.c
+static void update_event_displays();
+  //Updates displayed events
+static void minute_tick(void * data);
+  //Runs the app's minute tick handler
+static void activity_move(void * data);
+  //Simulates periodic wrist movement
+static uint32_t ms_to_next_minute();
+  //Gets the time until the next minute starts
+static bool run_script(const char * path);
+  //Runs every command in a script
+static bool run_command(char * line, const char * scriptDir);
+  //Runs one script command
+static bool parse_type(const char * name, UpdateType * type);
+  //Reads an update type name
+static const Metric * find_metric(const char * name);
+  //Finds a metric by name
+static void print_report(double cpuSeconds);
+  //Prints benchmark results
+
+//----------METRICS----------
+//Trace statistics, plus companion totals that only exist for the current run
+static uint64_t metric_duration(const TraceStats * stats){ return trace_stats_duration(stats) / 1000; }
+static uint64_t metric_opens(const TraceStats * stats){ return stats->opens; }
+static uint64_t metric_sends(const TraceStats * stats){ return stats->sends; }
+static uint64_t metric_retries(const TraceStats * stats){ return stats->retries; }
+static uint64_t metric_delivered(const TraceStats * stats){ return stats->delivered; }
+static uint64_t metric_failures(const TraceStats * stats){ return stats->failures; }
+static uint64_t metric_dropped(const TraceStats * stats){ return stats->dropped; }
+static uint64_t metric_received(const TraceStats * stats){ return stats->received; }
+static uint64_t metric_inbox_dropped(const TraceStats * stats){ return stats->inboxDropped; }
+static uint64_t metric_bytes_sent(const TraceStats * stats){ return stats->bytesSent; }
+static uint64_t metric_bytes_received(const TraceStats * stats){ return stats->bytesReceived; }
+static uint64_t metric_requests(const TraceStats * stats){
+  uint64_t total = 0;
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++)total += stats->requests[i];
+  return total;
+}
+static uint64_t metric_responses(const TraceStats * stats){
+  uint64_t total = 0;
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++)total += stats->responses[i];
+  return total;
+}
+static uint64_t metric_latency(const TraceStats * stats){
+  uint64_t total = 0;
+  uint64_t count = 0;
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    total += stats->latencyTotal[i];
+    count += stats->responses[i];
+  }
+  return count > 0 ? total / count : 0;
+}
+static uint64_t metric_metrics(const TraceStats * stats){ return companion_get_stats()->metrics; }
+static uint64_t metric_rejected(const TraceStats * stats){ return companion_get_stats()->rejected; }
+static uint64_t metric_undelivered(const TraceStats * stats){
+  return companion_get_stats()->undelivered;
+}
+static uint64_t metric_display(const TraceStats * stats){ return display_stub_updates(); }
+
+//Metrics in report order. Companion metrics come last, as baselines don't have them.
+static const Metric metrics[] = {
+  {"seconds", metric_duration},
+  {"opens", metric_opens},
+  {"requests", metric_requests},
+  {"responses", metric_responses},
+  {"latency", metric_latency},
+  {"sends", metric_sends},
+  {"retries", metric_retries},
+  {"delivered", metric_delivered},
+  {"failures", metric_failures},
+  {"dropped", metric_dropped},
+  {"received", metric_received},
+  {"inboxdropped", metric_inbox_dropped},
+  {"bytessent", metric_bytes_sent},
+  {"bytesreceived", metric_bytes_received},
+  {"metrics", metric_metrics},
+  {"rejected", metric_rejected},
+  {"undelivered", metric_undelivered},
+  {"display", metric_display}
+};
+#define NUM_METRICS (sizeof(metrics) / sizeof(metrics[0]))
+#define NUM_TRACE_METRICS 14 //Metrics read from trace statistics
+
+//Update type names used in scripts and reports, in UpdateType order
+static const char * typeNames[NUM_UPDATE_TYPES] = {
+  "event", "battery", "infotext", "weather", "stats"
+};
+
+//----------MAIN----------
+int main(int argc, char * argv[]){
+  bool benchmark = false;
+  int option;
+  while((option = getopt(argc, argv, "vtb")) != -1){
+    switch(option){
+      case 'v':
+        verbose = true;
+        break;
+      case 't':
+        printTrace = true;
+        break;
+      case 'b':
+        benchmark = true;
+        break;
+      default:
+        fprintf(stderr, "usage: %s [-v] [-t] [-b] script\n", argv[0]);
+        return 2;
+    }
+  }
+  if(optind != argc - 1){
+    fprintf(stderr, "usage: %s [-v] [-t] [-b] script\n", argv[0]);
+    return 2;
+  }
+  setenv("TZ", "UTC", 1);
+  tzset();
+  shim_set_time(START_TIME + START_HOUR * 3600);
+  shim_set_log_handler(log_line);
+  trace_stats_init(&current);
+  clock_t cpuStart = clock();
+  init_app();
+  bool success = run_script(argv[optind]);
+  double cpuSeconds = (double)(clock() - cpuStart) / CLOCKS_PER_SEC;
+  if(benchmark)print_report(cpuSeconds);
+  messaging_deinit();
+  events_deinit();
+  phone_battery_deinit();
+  companion_deinit();
+  shim_deinit();
+  if(failedExpectations > 0){
+    fprintf(stderr, "%s: %u expectation(s) failed\n", argv[optind], failedExpectations);
+    return 1;
+  }
+  return success ? 0 : 1;
+}
+
+//----------STATIC FUNCTIONS----------
+
+/**
+*Handles one app log line, collecting trace statistics
+*@param level the AppLogLevel
+*@param message the log message
+*/
+static void log_line(uint8_t level, const char * message){
+  TraceLine line;
+  if(trace_parse_line(message, &line)){
+    trace_stats_add(&current, &line);
+    if(printTrace)printf("%s\n", message);
+  }else if(verbose){
+    time_t now = time(NULL);
+    printf("[%02d:%02d:%02d] %s\n", (int)(now / 3600 % 24), (int)(now / 60 % 60),
+           (int)(now % 60), message);
+  }
+}
+
+/**
+*Initializes the app modules in the same order as main.c, then starts
+*the minute tick
+*/
+static void init_app(){
+  setLaunchTime(time(NULL));
+  companion_init();
+  forecast_init();
+  phone_battery_init();
+  events_init();
+  set_events_changed_handler(update_event_displays);
+  message_handler_init();
+  shim_schedule(ms_to_next_minute(), minute_tick, NULL);
+}
+
+/**
+*Updates displayed events, as main.c does when events change
+*/
+static void update_event_displays(){
+  for(int i = 0; i < NUM_EVENTS; i++){
+    char eventTitle[MAX_EVENT_LENGTH];
+    char eventTime[MAX_EVENT_LENGTH];
+    get_event_title(i, eventTitle, sizeof(eventTitle));
+    get_event_time_string(i, eventTime, sizeof(eventTime));
+    update_event_display(i, eventTitle, eventTime, get_percent_complete(i), get_event_color(i));
+  }
+}
+
+/**
+*Runs the messaging parts of the app's minute tick handler
+*@param data unused
+*/
+static void minute_tick(void * data){
+  time_t now = time(NULL);
+  update_forecast(now);
+  bool connected = connection_service_peek_pebble_app_connection();
+  update_phone_battery(now, connected);
+  if(connected)request_due_updates();
+  shim_schedule(ms_to_next_minute(), minute_tick, NULL);
+}
+
+/**
+*Simulates periodic wrist movement, so the app doesn't start resting
+*@param data unused
+*/
+static void activity_move(void * data){
+  moveScheduled = activityMinutes != 0;
+  if(!moveScheduled)return;
+  shim_move();
+  shim_schedule(activityMinutes * MS_PER_MINUTE, activity_move, NULL);
+}
+
+/**
+*Gets the time until the next minute starts
+*@return milliseconds to the next minute
+*/
+static uint32_t ms_to_next_minute(){
+  return MS_PER_MINUTE - shim_now_ms() % MS_PER_MINUTE;
+}
+
+/**
+*Runs every command in a script. Blank lines and anything after a '#'
+*are ignored.
+*@param path the script file
+*@return true if every command was valid, false otherwise
+*/
+static bool run_script(const char * path){
+  FILE * file = fopen(path, "r");
+  if(file == NULL){
+    fprintf(stderr, "%s: can't open script\n", path);
+    return false;
+  }
+  char pathCopy[MAX_LINE];
+  snprintf(pathCopy, sizeof(pathCopy), "%s", path);
+  const char * scriptDir = dirname(pathCopy);
+  char line[MAX_LINE];
+  int lineNum = 0;
+  bool success = true;
+  while(fgets(line, sizeof(line), file) != NULL){
+    lineNum++;
+    char * comment = strchr(line, '#');
+    if(comment != NULL)*comment = '\0';
+    line[strcspn(line, "\r\n")] = '\0';
+    if(strspn(line, " \t") == strlen(line))continue;
+    if(!run_command(line, scriptDir)){
+      fprintf(stderr, "%s:%d: invalid command: %s\n", path, lineNum, line);
+      success = false;
+      break;
+    }
+  }
+  fclose(file);
+  return success;
+}
+
+/**
+*Runs one script command
+*@param line the command line, without comments
+*@param scriptDir the script's directory, that replayed trace paths are relative to
+*@return true if the command was valid, false otherwise
+*/
+static bool run_command(char * line, const char * scriptDir){
+  char command[32];
+  int consumed;
+  if(sscanf(line, "%31s%n", command, &consumed) != 1)return false;
+  const char * args = line + consumed;
+  args += strspn(args, " \t");
+  unsigned a, b, c, d;
+  int temperature;
+  char text[MAX_LINE];
+  char operator[3];
+  UpdateType type;
+  if(strcmp(command, "run") == 0 && sscanf(args, "%u", &a) == 1){
+    shim_run_until(shim_now_ms() + (uint64_t) a * 1000);
+  }else if(strcmp(command, "activity") == 0 && sscanf(args, "%u", &a) == 1){
+    //Scheduled movement picks up the new period, otherwise movement starts now
+    activityMinutes = a;
+    if(!moveScheduled)activity_move(NULL);
+  }else if(strcmp(command, "move") == 0){
+    shim_move();
+  }else if(strcmp(command, "watchbattery") == 0 && sscanf(args, "%u", &a) == 1){
+    shim_set_watch_battery(a, strstr(args, "charging") != NULL);
+  }else if(strcmp(command, "memory") == 0 && sscanf(args, "%u", &a) == 1){
+    shim_set_app_message_memory(a);
+  }else if(strcmp(command, "latency") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_set_latency(a);
+  }else if(strcmp(command, "link") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_set_link_delay(a);
+  }else if(strcmp(command, "busy") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_inject_failures(APP_MSG_BUSY, a);
+  }else if(strcmp(command, "timeout") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_inject_failures(APP_MSG_SEND_TIMEOUT, a);
+  }else if(strcmp(command, "disconnect") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_disconnect(a * 1000);
+  }else if(strcmp(command, "packed") == 0 && sscanf(args, "%3s", text) == 1){
+    companion_set_packed(strcmp(text, "on") == 0);
+  }else if(strcmp(command, "subscriptions") == 0 && sscanf(args, "%3s", text) == 1){
+    companion_set_subscriptions(strcmp(text, "on") == 0);
+  }else if(strcmp(command, "battery") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_set_battery(a, strstr(args, "charging") != NULL);
+  }else if(strcmp(command, "infotext") == 0 && *args != '\0'){
+    companion_set_infotext(args);
+  }else if(strcmp(command, "weather") == 0 && sscanf(args, "%d %u", &temperature, &a) == 2){
+    companion_set_weather(temperature, a);
+  }else if(strcmp(command, "event") == 0 &&
+           sscanf(args, "%u %u %d %u %x %n", &a, &b, &temperature, &c, &d, &consumed) == 5){
+    //Start times are in minutes from now
+    companion_set_event(a, b, time(NULL) + temperature * 60, c * 60, d, args + consumed);
+  }else if(strcmp(command, "clearevent") == 0 && sscanf(args, "%u", &a) == 1){
+    companion_clear_event(a);
+  }else if(strcmp(command, "push") == 0 && parse_type(args, &type)){
+    companion_push(type);
+  }else if(strcmp(command, "freq") == 0 && parse_type(args, &type) &&
+           sscanf(args, "%*s %u", &a) == 1){
+    companion_send_update_freq(type, a);
+  }else if(strcmp(command, "replay") == 0 && sscanf(args, "%255s", text) == 1){
+    char path[2 * MAX_LINE];
+    snprintf(path, sizeof(path), "%s/%s", scriptDir, text);
+    int64_t duration = companion_replay(path, &baseline);
+    if(duration < 0){
+      fprintf(stderr, "%s: can't open trace\n", path);
+      return false;
+    }
+    //Only the replayed part of the run is compared against the trace
+    hasBaseline = true;
+    trace_stats_init(&current);
+    shim_run_until(shim_now_ms() + duration + REPLAY_MARGIN);
+    companion_end_replay();
+  }else if(strcmp(command, "expect") == 0 &&
+           sscanf(args, "%255s %2s %u", text, operator, &a) == 3){
+    const Metric * metric = find_metric(text);
+    if(metric == NULL)return false;
+    uint64_t value = metric->read(&current);
+    bool met;
+    if(strcmp(operator, "<=") == 0)met = value <= a;
+    else if(strcmp(operator, ">=") == 0)met = value >= a;
+    else if(strcmp(operator, "==") == 0)met = value == a;
+    else return false;
+    if(!met){
+      fprintf(stderr, "expected %s %s %u, got %llu\n", text, operator, a,
+              (unsigned long long) value);
+      failedExpectations++;
+    }
+  }else return false;
+  return true;
+}
+
+/**
+*Reads an update type name from the start of a string
+*@param name the string holding the type name
+*@param type set to the named update type
+*@return true if the name is a valid update type, false otherwise
+*/
+static bool parse_type(const char * name, UpdateType * type){
+  size_t length = strcspn(name, " \t");
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    if(strlen(typeNames[i]) == length && strncmp(name, typeNames[i], length) == 0){
+      *type = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+*Finds a metric by name
+*@param name the metric name
+*@return the metric, or NULL if there's no metric with that name
+*/
+static const Metric * find_metric(const char * name){
+  for(size_t i = 0; i < NUM_METRICS; i++){
+    if(strcmp(metrics[i].name, name) == 0)return &metrics[i];
+  }
+  return NULL;
+}
+
+/**
+*Prints benchmark results for the run, next to the last replayed trace if
+*there was one
+*@param cpuSeconds host CPU time taken by the run
+*/
+static void print_report(double cpuSeconds){
+  printf("%-16s %12s %12s\n", "metric", hasBaseline ? "baseline" : "", "current");
+  for(size_t i = 0; i < NUM_METRICS; i++){
+    char baselineValue[24] = "";
+    if(hasBaseline && i < NUM_TRACE_METRICS){
+      snprintf(baselineValue, sizeof(baselineValue), "%llu",
+               (unsigned long long) metrics[i].read(&baseline));
+    }
+    printf("%-16s %12s %12llu\n", metrics[i].name, baselineValue,
+           (unsigned long long) metrics[i].read(&current));
+  }
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    if(current.requests[i] == 0 && (!hasBaseline || baseline.requests[i] == 0))continue;
+    char name[32];
+    char baselineValue[24] = "";
+    snprintf(name, sizeof(name), "%s max ms", typeNames[i]);
+    if(hasBaseline)snprintf(baselineValue, sizeof(baselineValue), "%u", baseline.latencyMax[i]);
+    printf("%-16s %12s %12u\n", name, baselineValue, current.latencyMax[i]);
+  }
+  printf("%-16s %12s %12.2f\n", "cpu ms", "", cpuSeconds * 1000);
+}
@@ -0,0 +1,280 @@
+/**
+*@File pebble.h
+*Host stand-in for the parts of the Pebble SDK used by the messaging
+*modules. Declarations match the SDK, and are implemented by shim.c
+*against a simulated clock and a simulated phone connection.
+*/
+#pragma once
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <time.h>
+
+#define PBL_COLOR
+
+//----------LOGGING----------
+typedef enum{
+  APP_LOG_LEVEL_ERROR = 1,
+  APP_LOG_LEVEL_WARNING = 50,
+  APP_LOG_LEVEL_INFO = 100,
+  APP_LOG_LEVEL_DEBUG = 200,
+  APP_LOG_LEVEL_DEBUG_VERBOSE = 255
+} AppLogLevel;
+void app_log(uint8_t log_level, const char * src_filename, int src_line_number,
+             const char * fmt, ...) __attribute__((format(printf, 4, 5)));
+#define APP_LOG(level, fmt, ...) app_log(level, __FILE__, __LINE__, fmt, ##__VA_ARGS__)
+
+//----------TIME----------
+#define SECONDS_PER_MINUTE 60
+#define SECONDS_PER_HOUR 3600
+#define SECONDS_PER_DAY 86400
+typedef enum{
+  SECOND_UNIT = 1 << 0,
+  MINUTE_UNIT = 1 << 1,
+  HOUR_UNIT = 1 << 2,
+  DAY_UNIT = 1 << 3
+} TimeUnits;
+//Every module reads the simulated clock, implemented by shim.c
+time_t shim_time(time_t * tloc);
+#define time(tloc) shim_time(tloc)
+time_t time_ms(time_t * tloc, uint16_t * out_ms);
+time_t time_start_of_today(void);
+bool clock_is_24h_style(void);
+
+//----------PERSISTENT STORAGE----------
+#define PERSIST_DATA_MAX_LENGTH 256
+#define PERSIST_STRING_MAX_LENGTH PERSIST_DATA_MAX_LENGTH
+typedef enum{
+  S_SUCCESS = 0,
+  E_ERROR = -1,
+  E_UNKNOWN = -2,
+  E_INTERNAL = -3,
+  E_INVALID_ARGUMENT = -4,
+  E_OUT_OF_MEMORY = -5,
+  E_OUT_OF_STORAGE = -6,
+  E_OUT_OF_RESOURCES = -7,
+  E_RANGE = -8,
+  E_DOES_NOT_EXIST = -9,
+  E_INVALID_OPERATION = -10,
+  E_BUSY = -11,
+  S_TRUE = 1,
+  S_FALSE = 0,
+  S_NO_MORE_ITEMS = 2,
+  S_NO_ACTION_REQUIRED = 3
+} StatusCode;
+typedef int32_t status_t;
+bool persist_exists(const uint32_t key);
+int persist_get_size(const uint32_t key);
+int32_t persist_read_int(const uint32_t key);
+status_t persist_write_int(const uint32_t key, const int32_t value);
+bool persist_read_bool(const uint32_t key);
+status_t persist_write_bool(const uint32_t key, const bool value);
+int persist_read_data(const uint32_t key, void * buffer, const size_t buffer_size);
+int persist_write_data(const uint32_t key, const void * data, const size_t size);
+int persist_read_string(const uint32_t key, char * buffer, const size_t buffer_size);
+int persist_write_string(const uint32_t key, const char * cstring);
+status_t persist_delete(const uint32_t key);
+
+//----------DICTIONARIES----------
+typedef enum{
+  TUPLE_BYTE_ARRAY = 0,
+  TUPLE_CSTRING = 1,
+  TUPLE_UINT = 2,
+  TUPLE_INT = 3
+} TupleType;
+typedef struct __attribute__((__packed__)){
+  uint32_t key;
+  TupleType type:8;
+  uint16_t length;
+  union{
+    uint8_t data[0];
+    char cstring[0];
+    uint8_t uint8;
+    uint16_t uint16;
+    uint32_t uint32;
+    int8_t int8;
+    int16_t int16;
+    int32_t int32;
+  } value[];
+} Tuple;
+typedef struct Dictionary Dictionary;
+typedef struct{
+  Dictionary * dictionary;
+  const void * end;
+  Tuple * cursor;
+} DictionaryIterator;
+typedef enum{
+  DICT_OK = 0,
+  DICT_NOT_ENOUGH_STORAGE = 1 << 1,
+  DICT_INVALID_ARGS = 1 << 2,
+  DICT_INTERNAL_INCONSISTENCY = 1 << 3,
+  DICT_MALLOC_FAILED = 1 << 4
+} DictionaryResult;
+DictionaryResult dict_write_begin(DictionaryIterator * iter, uint8_t * const buffer, const uint16_t size);
+DictionaryResult dict_write_data(DictionaryIterator * iter, const uint32_t key, const uint8_t * const data,
+                                 const uint16_t size);
+DictionaryResult dict_write_cstring(DictionaryIterator * iter, const uint32_t key, const char * const cstring);
+DictionaryResult dict_write_int(DictionaryIterator * iter, const uint32_t key, const void * integer,
+                                const uint8_t width_bytes, const bool is_signed);
+DictionaryResult dict_write_uint8(DictionaryIterator * iter, const uint32_t key, const uint8_t value);
+DictionaryResult dict_write_uint16(DictionaryIterator * iter, const uint32_t key, const uint16_t value);
+DictionaryResult dict_write_uint32(DictionaryIterator * iter, const uint32_t key, const uint32_t value);
+DictionaryResult dict_write_int8(DictionaryIterator * iter, const uint32_t key, const int8_t value);
+DictionaryResult dict_write_int16(DictionaryIterator * iter, const uint32_t key, const int16_t value);
+DictionaryResult dict_write_int32(DictionaryIterator * iter, const uint32_t key, const int32_t value);
+uint32_t dict_write_end(DictionaryIterator * iter);
+uint32_t dict_size(DictionaryIterator * iter);
+Tuple * dict_read_begin_from_buffer(DictionaryIterator * iter, const uint8_t * const buffer, const uint16_t size);
+Tuple * dict_read_first(DictionaryIterator * iter);
+Tuple * dict_read_next(DictionaryIterator * iter);
+Tuple * dict_find(const DictionaryIterator * iter, const uint32_t key);
+
+//----------APPMESSAGE----------
+#define APP_MESSAGE_INBOX_SIZE_MINIMUM 124
+#define APP_MESSAGE_OUTBOX_SIZE_MINIMUM 636
+typedef enum{
+  APP_MSG_OK = 0,
+  APP_MSG_SEND_TIMEOUT = 1 << 1,
+  APP_MSG_SEND_REJECTED = 1 << 2,
+  APP_MSG_NOT_CONNECTED = 1 << 3,
+  APP_MSG_APP_NOT_RUNNING = 1 << 4,
+  APP_MSG_INVALID_ARGS = 1 << 5,
+  APP_MSG_BUSY = 1 << 6,
+  APP_MSG_BUFFER_OVERFLOW = 1 << 7,
+  APP_MSG_ALREADY_RELEASED = 1 << 9,
+  APP_MSG_CALLBACK_ALREADY_REGISTERED = 1 << 10,
+  APP_MSG_CALLBACK_NOT_REGISTERED = 1 << 11,
+  APP_MSG_OUT_OF_MEMORY = 1 << 12,
+  APP_MSG_CLOSED = 1 << 13,
+  APP_MSG_INTERNAL_ERROR = 1 << 14,
+  APP_MSG_INVALID_STATE = 1 << 15
+} AppMessageResult;
+typedef void (* AppMessageInboxReceived)(DictionaryIterator * iterator, void * context);
+typedef void (* AppMessageInboxDropped)(AppMessageResult reason, void * context);
+typedef void (* AppMessageOutboxSent)(DictionaryIterator * iterator, void * context);
+typedef void (* AppMessageOutboxFailed)(DictionaryIterator * iterator, AppMessageResult reason,
+                                        void * context);
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound);
+void app_message_deregister_callbacks(void);
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback);
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback);
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback);
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback);
+uint32_t app_message_inbox_size_maximum(void);
+uint32_t app_message_outbox_size_maximum(void);
+AppMessageResult app_message_outbox_begin(DictionaryIterator ** iterator);
+AppMessageResult app_message_outbox_send(void);
+
+//----------TIMERS AND WAKEUPS----------
+typedef struct AppTimer AppTimer;
+typedef void (* AppTimerCallback)(void * data);
+AppTimer * app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void * callback_data);
+bool app_timer_reschedule(AppTimer * timer_handle, uint32_t new_timeout_ms);
+void app_timer_cancel(AppTimer * timer_handle);
+typedef int32_t WakeupId;
+typedef void (* WakeupHandler)(WakeupId wakeup_id, int32_t cookie);
+void wakeup_service_subscribe(WakeupHandler handler);
+WakeupId wakeup_schedule(time_t timestamp, int32_t cookie, bool notify_if_missed);
+void wakeup_cancel(WakeupId wakeup_id);
+void wakeup_cancel_all(void);
+bool wakeup_get_launch_event(WakeupId * wakeup_id, int32_t * cookie);
+bool wakeup_query(WakeupId wakeup_id, time_t * timestamp);
+typedef enum{
+  APP_LAUNCH_SYSTEM,
+  APP_LAUNCH_USER,
+  APP_LAUNCH_PHONE,
+  APP_LAUNCH_WAKEUP,
+  APP_LAUNCH_WORKER,
+  APP_LAUNCH_QUICK_LAUNCH,
+  APP_LAUNCH_TIMELINE_ACTION,
+  APP_LAUNCH_SMARTSTRAP
+} AppLaunchReason;
+AppLaunchReason launch_reason(void);
+
+//----------EVENT SERVICES----------
+typedef struct{
+  uint8_t charge_percent;
+  bool is_charging;
+  bool is_plugged;
+} BatteryChargeState;
+typedef void (* BatteryStateHandler)(BatteryChargeState charge);
+BatteryChargeState battery_state_service_peek(void);
+void battery_state_service_subscribe(BatteryStateHandler handler);
+void battery_state_service_unsubscribe(void);
+typedef void (* ConnectionHandler)(bool connected);
+typedef struct{
+  ConnectionHandler pebble_app_connection_handler;
+  ConnectionHandler pebblekit_connection_handler;
+} ConnectionHandlers;
+bool connection_service_peek_pebble_app_connection(void);
+void connection_service_subscribe(ConnectionHandlers conn_handlers);
+void connection_service_unsubscribe(void);
+typedef enum{
+  ACCEL_AXIS_X = 0,
+  ACCEL_AXIS_Y = 1,
+  ACCEL_AXIS_Z = 2
+} AccelAxisType;
+typedef void (* AccelTapHandler)(AccelAxisType axis, int32_t direction);
+void accel_tap_service_subscribe(AccelTapHandler handler);
+void accel_tap_service_unsubscribe(void);
+typedef struct{
+  int16_t x;
+  int16_t y;
+  int16_t z;
+  bool did_vibrate;
+  uint64_t timestamp;
+} AccelData;
+typedef enum{
+  ACCEL_SAMPLING_10HZ = 10,
+  ACCEL_SAMPLING_25HZ = 25,
+  ACCEL_SAMPLING_50HZ = 50,
+  ACCEL_SAMPLING_100HZ = 100
+} AccelSamplingRate;
+typedef void (* AccelDataHandler)(AccelData * data, uint32_t num_samples);
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler);
+void accel_data_service_unsubscribe(void);
+int accel_service_set_sampling_rate(AccelSamplingRate rate);
+void vibes_short_pulse(void);
+void vibes_double_pulse(void);
+
+//----------WATCH INFO----------
+typedef enum{
+  WATCH_INFO_MODEL_UNKNOWN,
+  WATCH_INFO_MODEL_PEBBLE_ORIGINAL,
+  WATCH_INFO_MODEL_PEBBLE_STEEL,
+  WATCH_INFO_MODEL_PEBBLE_TIME
+} WatchInfoModel;
+typedef enum{
+  WATCH_INFO_COLOR_UNKNOWN = 0
+} WatchInfoColor;
+WatchInfoModel watch_info_get_model(void);
+WatchInfoColor watch_info_get_color(void);
+size_t heap_bytes_used(void);
+size_t heap_bytes_free(void);
+
+//----------GRAPHICS----------
+//Only the types the messaging modules and their headers refer to
+typedef union GColor8{
+  uint8_t argb;
+  struct{
+    uint8_t b:2;
+    uint8_t g:2;
+    uint8_t r:2;
+    uint8_t a:2;
+  };
+} GColor8;
+typedef GColor8 GColor;
+#define GColorClearARGB8 ((uint8_t)0x00)
+#define GColorBlackARGB8 ((uint8_t)0xC0)
+#define GColorWhiteARGB8 ((uint8_t)0xFF)
+#define GColorClear ((GColor8){.argb = GColorClearARGB8})
+#define GColorBlack ((GColor8){.argb = GColorBlackARGB8})
+#define GColorWhite ((GColor8){.argb = GColorWhiteARGB8})
+#define GColorFromRGB(red, green, blue) ((GColor8){.argb = 0xC0 | (((red) >> 6) << 4) \
+  | (((green) >> 6) << 2) | ((blue) >> 6)})
+#define GColorFromHEX(v) GColorFromRGB(((v) >> 16) & 0xFF, ((v) >> 8) & 0xFF, (v) & 0xFF)
+typedef struct TextLayer TextLayer;
+void text_layer_set_text(TextLayer * text_layer, const char * text);
@@ -0,0 +1,672 @@
+#include <pebble.h>
+#include <stdarg.h>
+#include "shim.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+#define MAX_PERSIST_KEYS 128 //Persistent keys the simulated storage can hold
+#define INBOX_SIZE_MAXIMUM 8200 //app_message_inbox_size_maximum on SDK3 watches
+#define OUTBOX_SIZE_MAXIMUM 8200 //app_message_outbox_size_maximum on SDK3 watches
+#define LOG_BUFFER_SIZE 512
+
+//----------SHIM DATA STRUCTURES----------
+//An app timer, or a phone event scheduled by the harness
+struct AppTimer{
+  uint64_t due;//simulated time the callback runs, in milliseconds
+  ShimCallback callback;
+  void * data;
+  bool scheduled;//true while waiting in the schedule
+  struct AppTimer * next;//next scheduled entry, in due order
+  struct AppTimer * allocated;//next allocated entry, for freeing everything
+};
+
+//One persistent storage value
+struct persistValue{
+  bool used;
+  uint32_t key;
+  uint16_t size;
+  uint8_t data[PERSIST_DATA_MAX_LENGTH];
+};
+
+//----------LOCAL VARIABLES----------
+static uint64_t nowMs = 0;//simulated time
+static struct AppTimer * schedule = NULL;//scheduled entries, soonest first
+static struct AppTimer * allocatedEntries = NULL;//every entry ever allocated
+static ShimLogHandler logHandler = NULL;
+static struct persistValue storage[MAX_PERSIST_KEYS];
+
+static const ShimPhone * phone = NULL;
+static bool connected = true;
+static ConnectionHandlers connectionHandlers = {0};
+static BatteryChargeState batteryState = {.charge_percent = 80};
+static BatteryStateHandler batteryHandler = NULL;
+static AccelTapHandler tapHandler = NULL;
+static AccelDataHandler accelHandler = NULL;
+static uint32_t accelSamples = 0;//samples per accelerometer batch
+static AccelSamplingRate accelRate = ACCEL_SAMPLING_25HZ;
+
+static uint32_t appMessageMemory = 0;//largest inbox and outbox total, or 0 for no limit
+static bool appMessageOpen = false;
+static uint32_t inboxSize = 0;
+static uint32_t outboxSize = 0;
+static uint8_t * outbox = NULL;
+static DictionaryIterator outboxIterator;
+static bool outboxReserved = false;//true from app_message_outbox_begin until the send completes
+static bool outboxSending = false;//true while waiting for an ack
+static uint32_t outboxSendId = 0;//identifies the send an outcome belongs to
+static AppMessageResult outboxResult = APP_MSG_OK;//outcome of the message being sent
+static AppMessageInboxReceived inboxReceived = NULL;
+static AppMessageInboxDropped inboxDropped = NULL;
+static AppMessageOutboxSent outboxSent = NULL;
+static AppMessageOutboxFailed outboxFailed = NULL;
+
+//----------STATIC FUNCTION DECLARATIONS----------
+static struct AppTimer * new_entry();
+  //Allocates a schedule entry
+static void insert_entry(struct AppTimer * entry);
+  //Adds an entry to the schedule, in due order
+static void remove_entry(struct AppTimer * entry);
+  //Removes an entry from the schedule
+static struct persistValue * find_value(uint32_t key, bool create);
+  //Finds a persistent storage value
+static DictionaryResult write_tuple(DictionaryIterator * iter, uint32_t key, TupleType type,
+                                    const void * data, uint16_t size);
+  //Appends one tuple to a dictionary being written
+static void complete_send(void * data);
+  //Delivers the outcome of a watch message to the app
+
+//----------SIMULATION CONTROL----------
+//Gets the simulated time in milliseconds
+uint64_t shim_now_ms(){
+  return nowMs;
+}
+
+//Sets the simulated time
+void shim_set_time(time_t seconds){
+  nowMs = (uint64_t) seconds * 1000;
+}
+
+//Schedules a callback on the simulated clock
+void shim_schedule(uint32_t delayMs, ShimCallback callback, void * data){
+  struct AppTimer * entry = new_entry();
+  entry->callback = callback;
+  entry->data = data;
+  entry->due = nowMs + delayMs;
+  insert_entry(entry);
+}
+
+//Runs everything due up to a given time
+void shim_run_until(uint64_t endMs){
+  while(schedule != NULL && schedule->due <= endMs){
+    struct AppTimer * entry = schedule;
+    remove_entry(entry);
+    if(entry->due > nowMs)nowMs = entry->due;
+    entry->callback(entry->data);
+  }
+  if(endMs > nowMs)nowMs = endMs;
+}
+
+//Connects the phone side of AppMessage
+void shim_set_phone(const ShimPhone * newPhone){
+  phone = newPhone;
+}
+
+//Delivers a message from the phone to the watch inbox
+AppMessageResult shim_deliver(const uint8_t * data, uint32_t size){
+  if(!connected)return APP_MSG_NOT_CONNECTED;
+  if(!appMessageOpen || inboxReceived == NULL)return APP_MSG_APP_NOT_RUNNING;
+  if(size > inboxSize){
+    if(inboxDropped != NULL)inboxDropped(APP_MSG_BUFFER_OVERFLOW, NULL);
+    return APP_MSG_BUFFER_OVERFLOW;
+  }
+  //The app may reopen AppMessage while reading, so it gets its own copy
+  uint8_t * inbox = malloc(size);
+  memcpy(inbox, data, size);
+  DictionaryIterator iterator;
+  dict_read_begin_from_buffer(&iterator, inbox, size);
+  inboxReceived(&iterator, NULL);
+  free(inbox);
+  return APP_MSG_OK;
+}
+
+//Connects or disconnects the phone
+void shim_set_connected(bool newConnected){
+  if(newConnected == connected)return;
+  connected = newConnected;
+  if(connectionHandlers.pebble_app_connection_handler != NULL)
+    connectionHandlers.pebble_app_connection_handler(connected);
+}
+
+//Limits the memory available to AppMessage buffers
+void shim_set_app_message_memory(uint32_t bytes){
+  appMessageMemory = bytes;
+}
+
+//Sets the watch battery state
+void shim_set_watch_battery(uint8_t percent, bool charging){
+  batteryState.charge_percent = percent;
+  batteryState.is_charging = charging;
+  batteryState.is_plugged = charging;
+  if(batteryHandler != NULL)batteryHandler(batteryState);
+}
+
+//Simulates wrist movement
+void shim_move(){
+  if(tapHandler != NULL)tapHandler(ACCEL_AXIS_Z, 1);
+  if(accelHandler == NULL || accelSamples == 0)return;
+  //One batch of samples from a wrist swinging back and forth
+  AccelData * data = calloc(accelSamples, sizeof(AccelData));
+  for(uint32_t i = 0; i < accelSamples; i++){
+    data[i].x = (i % 2) ? 400 : -400;
+    data[i].z = -1000;
+    data[i].timestamp = nowMs - (accelSamples - 1 - i) * 1000 / accelRate;
+  }
+  accelHandler(data, accelSamples);
+  free(data);
+}
+
+//Sets the function that receives app log lines
+void shim_set_log_handler(ShimLogHandler handler){
+  logHandler = handler;
+}
+
+//Frees everything the shim allocated
+void shim_deinit(){
+  while(allocatedEntries != NULL){
+    struct AppTimer * next = allocatedEntries->allocated;
+    free(allocatedEntries);
+    allocatedEntries = next;
+  }
+  schedule = NULL;
+  free(outbox);
+  outbox = NULL;
+}
+
+//----------LOGGING----------
+//Formats a log line and passes it to the log handler
+void app_log(uint8_t log_level, const char * src_filename, int src_line_number,
+             const char * fmt, ...){
+  if(logHandler == NULL)return;
+  char message[LOG_BUFFER_SIZE];
+  va_list args;
+  va_start(args, fmt);
+  vsnprintf(message, sizeof(message), fmt, args);
+  va_end(args);
+  logHandler(log_level, message);
+}
+
+//----------TIME----------
+//Gets the simulated time in seconds
+time_t shim_time(time_t * tloc){
+  time_t seconds = nowMs / 1000;
+  if(tloc != NULL)*tloc = seconds;
+  return seconds;
+}
+
+//Gets the simulated time in seconds and milliseconds
+time_t time_ms(time_t * tloc, uint16_t * out_ms){
+  if(out_ms != NULL)*out_ms = nowMs % 1000;
+  return shim_time(tloc);
+}
+
+//Gets the time the current day began
+time_t time_start_of_today(void){
+  time_t now = shim_time(NULL);
+  struct tm * today = localtime(&now);
+  today->tm_hour = 0;
+  today->tm_min = 0;
+  today->tm_sec = 0;
+  return mktime(today);
+}
+
+//The simulated watch uses 24 hour time
+bool clock_is_24h_style(void){
+  return true;
+}
+
+//----------PERSISTENT STORAGE----------
+bool persist_exists(const uint32_t key){
+  return find_value(key, false) != NULL;
+}
+
+int persist_get_size(const uint32_t key){
+  struct persistValue * value = find_value(key, false);
+  return value != NULL ? value->size : E_DOES_NOT_EXIST;
+}
+
+int32_t persist_read_int(const uint32_t key){
+  int32_t result = 0;
+  persist_read_data(key, &result, sizeof(result));
+  return result;
+}
+
+status_t persist_write_int(const uint32_t key, const int32_t value){
+  return persist_write_data(key, &value, sizeof(value));
+}
+
+bool persist_read_bool(const uint32_t key){
+  return persist_read_int(key) != 0;
+}
+
+status_t persist_write_bool(const uint32_t key, const bool value){
+  return persist_write_int(key, value);
+}
+
+int persist_read_data(const uint32_t key, void * buffer, const size_t buffer_size){
+  struct persistValue * value = find_value(key, false);
+  if(value == NULL)return E_DOES_NOT_EXIST;
+  size_t size = value->size < buffer_size ? value->size : buffer_size;
+  memcpy(buffer, value->data, size);
+  return size;
+}
+
+int persist_write_data(const uint32_t key, const void * data, const size_t size){
+  if(size > PERSIST_DATA_MAX_LENGTH)return E_RANGE;
+  struct persistValue * value = find_value(key, true);
+  if(value == NULL)return E_OUT_OF_STORAGE;
+  memcpy(value->data, data, size);
+  value->size = size;
+  return size;
+}
+
+int persist_read_string(const uint32_t key, char * buffer, const size_t buffer_size){
+  int size = persist_read_data(key, buffer, buffer_size);
+  if(size > 0)buffer[size - 1] = '\0';
+  return size;
+}
+
+int persist_write_string(const uint32_t key, const char * cstring){
+  return persist_write_data(key, cstring, strlen(cstring) + 1);
+}
+
+status_t persist_delete(const uint32_t key){
+  struct persistValue * value = find_value(key, false);
+  if(value == NULL)return E_DOES_NOT_EXIST;
+  value->used = false;
+  return S_SUCCESS;
+}
+
+//----------DICTIONARIES----------
+//Dictionaries are a tuple count followed by packed tuples, as on the watch
+struct Dictionary{
+  uint8_t count;
+  Tuple head[];
+};
+
+DictionaryResult dict_write_begin(DictionaryIterator * iter, uint8_t * const buffer, const uint16_t size){
+  if(iter == NULL || buffer == NULL || size < sizeof(Dictionary))return DICT_INVALID_ARGS;
+  iter->dictionary = (Dictionary *) buffer;
+  iter->dictionary->count = 0;
+  iter->cursor = iter->dictionary->head;
+  iter->end = buffer + size;
+  return DICT_OK;
+}
+
+DictionaryResult dict_write_data(DictionaryIterator * iter, const uint32_t key, const uint8_t * const data,
+                                 const uint16_t size){
+  return write_tuple(iter, key, TUPLE_BYTE_ARRAY, data, size);
+}
+
+DictionaryResult dict_write_cstring(DictionaryIterator * iter, const uint32_t key, const char * const cstring){
+  return write_tuple(iter, key, TUPLE_CSTRING, cstring, cstring != NULL ? strlen(cstring) + 1 : 0);
+}
+
+DictionaryResult dict_write_int(DictionaryIterator * iter, const uint32_t key, const void * integer,
+                                const uint8_t width_bytes, const bool is_signed){
+  if(width_bytes != 1 && width_bytes != 2 && width_bytes != 4)return DICT_INVALID_ARGS;
+  return write_tuple(iter, key, is_signed ? TUPLE_INT : TUPLE_UINT, integer, width_bytes);
+}
+
+DictionaryResult dict_write_uint8(DictionaryIterator * iter, const uint32_t key, const uint8_t value){
+  return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_uint16(DictionaryIterator * iter, const uint32_t key, const uint16_t value){
+  return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_uint32(DictionaryIterator * iter, const uint32_t key, const uint32_t value){
+  return dict_write_int(iter, key, &value, sizeof(value), false);
+}
+
+DictionaryResult dict_write_int8(DictionaryIterator * iter, const uint32_t key, const int8_t value){
+  return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+DictionaryResult dict_write_int16(DictionaryIterator * iter, const uint32_t key, const int16_t value){
+  return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+DictionaryResult dict_write_int32(DictionaryIterator * iter, const uint32_t key, const int32_t value){
+  return dict_write_int(iter, key, &value, sizeof(value), true);
+}
+
+uint32_t dict_write_end(DictionaryIterator * iter){
+  iter->end = iter->cursor;
+  return dict_size(iter);
+}
+
+uint32_t dict_size(DictionaryIterator * iter){
+  return (const uint8_t *) iter->end - (const uint8_t *) iter->dictionary;
+}
+
+Tuple * dict_read_begin_from_buffer(DictionaryIterator * iter, const uint8_t * const buffer, const uint16_t size){
+  if(iter == NULL || buffer == NULL || size < sizeof(Dictionary))return NULL;
+  iter->dictionary = (Dictionary *) buffer;
+  iter->end = buffer + size;
+  return dict_read_first(iter);
+}
+
+Tuple * dict_read_first(DictionaryIterator * iter){
+  iter->cursor = iter->dictionary->head;
+  if(iter->dictionary->count == 0 ||
+     (const uint8_t *) iter->cursor + sizeof(Tuple) > (const uint8_t *) iter->end)return NULL;
+  return iter->cursor;
+}
+
+Tuple * dict_read_next(DictionaryIterator * iter){
+  Tuple * next = (Tuple *)((uint8_t *) iter->cursor + sizeof(Tuple) + iter->cursor->length);
+  if((const uint8_t *) next + sizeof(Tuple) > (const uint8_t *) iter->end ||
+     (const uint8_t *) next + sizeof(Tuple) + next->length > (const uint8_t *) iter->end)return NULL;
+  iter->cursor = next;
+  return next;
+}
+
+Tuple * dict_find(const DictionaryIterator * iter, const uint32_t key){
+  DictionaryIterator search = *iter;
+  for(Tuple * tuple = dict_read_first(&search); tuple != NULL; tuple = dict_read_next(&search)){
+    if(tuple->key == key)return tuple;
+  }
+  return NULL;
+}
+
+//----------APPMESSAGE----------
+AppMessageResult app_message_open(const uint32_t size_inbound, const uint32_t size_outbound){
+  if(appMessageMemory != 0 && size_inbound + size_outbound > appMessageMemory)
+    return APP_MSG_OUT_OF_MEMORY;
+  //Reopening discards the outbox, along with any message being sent
+  free(outbox);
+  outbox = malloc(size_outbound);
+  inboxSize = size_inbound;
+  outboxSize = size_outbound;
+  outboxReserved = false;
+  outboxSending = false;
+  outboxSendId++;
+  appMessageOpen = true;
+  return APP_MSG_OK;
+}
+
+void app_message_deregister_callbacks(void){
+  inboxReceived = NULL;
+  inboxDropped = NULL;
+  outboxSent = NULL;
+  outboxFailed = NULL;
+}
+
+AppMessageInboxReceived app_message_register_inbox_received(AppMessageInboxReceived received_callback){
+  AppMessageInboxReceived old = inboxReceived;
+  inboxReceived = received_callback;
+  return old;
+}
+
+AppMessageInboxDropped app_message_register_inbox_dropped(AppMessageInboxDropped dropped_callback){
+  AppMessageInboxDropped old = inboxDropped;
+  inboxDropped = dropped_callback;
+  return old;
+}
+
+AppMessageOutboxSent app_message_register_outbox_sent(AppMessageOutboxSent sent_callback){
+  AppMessageOutboxSent old = outboxSent;
+  outboxSent = sent_callback;
+  return old;
+}
+
+AppMessageOutboxFailed app_message_register_outbox_failed(AppMessageOutboxFailed failed_callback){
+  AppMessageOutboxFailed old = outboxFailed;
+  outboxFailed = failed_callback;
+  return old;
+}
+
+uint32_t app_message_inbox_size_maximum(void){
+  return INBOX_SIZE_MAXIMUM;
+}
+
+uint32_t app_message_outbox_size_maximum(void){
+  return OUTBOX_SIZE_MAXIMUM;
+}
+
+AppMessageResult app_message_outbox_begin(DictionaryIterator ** iterator){
+  if(!appMessageOpen)return APP_MSG_INVALID_STATE;
+  if(outboxReserved)return APP_MSG_BUSY;
+  dict_write_begin(&outboxIterator, outbox, outboxSize);
+  outboxReserved = true;
+  *iterator = &outboxIterator;
+  return APP_MSG_OK;
+}
+
+AppMessageResult app_message_outbox_send(void){
+  if(!outboxReserved || outboxSending)return APP_MSG_INVALID_STATE;
+  uint32_t size = dict_write_end(&outboxIterator);
+  ShimSendOutcome outcome = {APP_MSG_NOT_CONNECTED, 0};
+  if(connected && phone != NULL)outcome = phone->receive(outbox, size);
+  outboxSending = true;
+  outboxResult = outcome.result;
+  //The outcome only applies if AppMessage isn't reopened before it arrives
+  shim_schedule(outcome.delayMs, complete_send, (void *)(uintptr_t) outboxSendId);
+  return APP_MSG_OK;
+}
+
+//----------TIMERS AND WAKEUPS----------
+AppTimer * app_timer_register(uint32_t timeout_ms, AppTimerCallback callback, void * callback_data){
+  struct AppTimer * entry = new_entry();
+  entry->callback = callback;
+  entry->data = callback_data;
+  entry->due = nowMs + timeout_ms;
+  insert_entry(entry);
+  return entry;
+}
+
+bool app_timer_reschedule(AppTimer * timer_handle, uint32_t new_timeout_ms){
+  if(timer_handle == NULL || !timer_handle->scheduled)return false;
+  remove_entry(timer_handle);
+  timer_handle->due = nowMs + new_timeout_ms;
+  insert_entry(timer_handle);
+  return true;
+}
+
+void app_timer_cancel(AppTimer * timer_handle){
+  if(timer_handle != NULL && timer_handle->scheduled)remove_entry(timer_handle);
+}
+
+//Wakeups are only used to relaunch the app, which the harness never closes
+void wakeup_service_subscribe(WakeupHandler handler){}
+
+WakeupId wakeup_schedule(time_t timestamp, int32_t cookie, bool notify_if_missed){
+  static WakeupId nextId = 1;
+  return nextId++;
+}
+
+void wakeup_cancel(WakeupId wakeup_id){}
+
+void wakeup_cancel_all(void){}
+
+bool wakeup_get_launch_event(WakeupId * wakeup_id, int32_t * cookie){
+  return false;
+}
+
+bool wakeup_query(WakeupId wakeup_id, time_t * timestamp){
+  return false;
+}
+
+AppLaunchReason launch_reason(void){
+  return APP_LAUNCH_USER;
+}
+
+//----------EVENT SERVICES----------
+BatteryChargeState battery_state_service_peek(void){
+  return batteryState;
+}
+
+void battery_state_service_subscribe(BatteryStateHandler handler){
+  batteryHandler = handler;
+}
+
+void battery_state_service_unsubscribe(void){
+  batteryHandler = NULL;
+}
+
+bool connection_service_peek_pebble_app_connection(void){
+  return connected;
+}
+
+void connection_service_subscribe(ConnectionHandlers conn_handlers){
+  connectionHandlers = conn_handlers;
+}
+
+void connection_service_unsubscribe(void){
+  memset(&connectionHandlers, 0, sizeof(connectionHandlers));
+}
+
+void accel_tap_service_subscribe(AccelTapHandler handler){
+  tapHandler = handler;
+}
+
+void accel_tap_service_unsubscribe(void){
+  tapHandler = NULL;
+}
+
+void accel_data_service_subscribe(uint32_t samples_per_update, AccelDataHandler handler){
+  accelSamples = samples_per_update;
+  accelHandler = handler;
+}
+
+void accel_data_service_unsubscribe(void){
+  accelHandler = NULL;
+  accelSamples = 0;
+}
+
+int accel_service_set_sampling_rate(AccelSamplingRate rate){
+  accelRate = rate;
+  return 0;
+}
+
+void vibes_short_pulse(void){}
+
+void vibes_double_pulse(void){}
+
+//----------WATCH INFO----------
+WatchInfoModel watch_info_get_model(void){
+  return WATCH_INFO_MODEL_PEBBLE_TIME;
+}
+
+WatchInfoColor watch_info_get_color(void){
+  return WATCH_INFO_COLOR_UNKNOWN;
+}
+
+size_t heap_bytes_used(void){
+  return 12000;
+}
+
+size_t heap_bytes_free(void){
+  return 12000;
+}
+
+//Text layers are never created by the messaging modules
+void text_layer_set_text(TextLayer * text_layer, const char * text){}
+
+//----------STATIC FUNCTIONS----------
+
+/**
+*Allocates a schedule entry, to be freed by shim_deinit. Entries are never
+*reused, so app timer handles stay valid after their timer has fired.
+*@return the new entry
+*/
+static struct AppTimer * new_entry(){
+  struct AppTimer * entry = calloc(1, sizeof(struct AppTimer));
+  entry->allocated = allocatedEntries;
+  allocatedEntries = entry;
+  return entry;
+}
+
+/**
+*Adds an entry to the schedule, after any entries due at the same time
+*@param entry an entry that isn't scheduled, with its due time set
+*/
+static void insert_entry(struct AppTimer * entry){
+  entry->scheduled = true;
+  struct AppTimer ** position = &schedule;
+  while(*position != NULL && (*position)->due <= entry->due)position = &(*position)->next;
+  entry->next = *position;
+  *position = entry;
+}
+
+/**
+*Removes an entry from the schedule
+*@param entry a scheduled entry
+*/
+static void remove_entry(struct AppTimer * entry){
+  struct AppTimer ** position = &schedule;
+  while(*position != NULL && *position != entry)position = &(*position)->next;
+  if(*position != NULL)*position = entry->next;
+  entry->next = NULL;
+  entry->scheduled = false;
+}
+
+/**
+*Finds a persistent storage value
+*@param key the storage key
+*@param create true to claim an unused value if the key isn't stored
+*@return the value, or NULL if it wasn't found or storage is full
+*/
+static struct persistValue * find_value(uint32_t key, bool create){
+  struct persistValue * unused = NULL;
+  for(int i = 0; i < MAX_PERSIST_KEYS; i++){
+    if(storage[i].used && storage[i].key == key)return &storage[i];
+    if(!storage[i].used && unused == NULL)unused = &storage[i];
+  }
+  if(!create || unused == NULL)return NULL;
+  unused->used = true;
+  unused->key = key;
+  unused->size = 0;
+  return unused;
+}
+
+/**
+*Appends one tuple to a dictionary being written
+*@param iter the dictionary iterator
+*@param key the tuple key
+*@param type the tuple type
+*@param data the tuple value
+*@param size the value size in bytes
+*@return DICT_OK, or DICT_NOT_ENOUGH_STORAGE if the tuple doesn't fit
+*/
+static DictionaryResult write_tuple(DictionaryIterator * iter, uint32_t key, TupleType type,
+                                    const void * data, uint16_t size){
+  if((const uint8_t *) iter->cursor + sizeof(Tuple) + size > (const uint8_t *) iter->end)
+    return DICT_NOT_ENOUGH_STORAGE;
+  iter->cursor->key = key;
+  iter->cursor->type = type;
+  iter->cursor->length = size;
+  if(size > 0)memcpy(iter->cursor->value->data, data, size);
+  iter->cursor = (Tuple *)((uint8_t *) iter->cursor + sizeof(Tuple) + size);
+  iter->dictionary->count++;
+  return DICT_OK;
+}
+
+/**
+*Delivers the outcome of a watch message to the app, unless AppMessage
+*was reopened since it was sent
+*@param data the ID of the send the outcome belongs to
+*/
+static void complete_send(void * data){
+  if((uintptr_t) data != outboxSendId || !outboxSending)return;
+  AppMessageResult result = outboxResult;
+  //A phone that disconnected before acknowledging never acknowledges
+  if(result == APP_MSG_OK && !connected)result = APP_MSG_SEND_TIMEOUT;
+  outboxSending = false;
+  outboxReserved = false;
+  DictionaryIterator iterator;
+  dict_read_begin_from_buffer(&iterator, outbox, (const uint8_t *) outboxIterator.end - outbox);
+  if(result == APP_MSG_OK){
+    if(outboxSent != NULL)outboxSent(&iterator, NULL);
+  }else if(outboxFailed != NULL)outboxFailed(&iterator, result, NULL);
+}
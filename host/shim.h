@@ -0,0 +1,118 @@
+/**
+*@File shim.h
+*Host implementation of the Pebble SDK calls in pebble.h. Time is
+*simulated: nothing happens between calls to shim_run_until, which runs
+*app timers and scheduled phone events in time order. The phone side of
+*AppMessage is handed to a ShimPhone, so a companion stand-in can answer,
+*delay or reject each message.
+*/
+#pragma once
+#include <pebble.h>
+
+//Outcome of a watch message delivered to the phone
+typedef struct{
+  AppMessageResult result;//APP_MSG_OK to ack, or the failure the watch should see
+  uint32_t delayMs;//milliseconds until the watch gets the ack or failure
+} ShimSendOutcome;
+
+//Phone side of the simulated connection
+typedef struct{
+  /**
+  *Receives a message sent by the watch
+  *@param data the message dictionary
+  *@param size the dictionary size in bytes
+  *@return whether the message is acknowledged, and when
+  */
+  ShimSendOutcome (* receive)(const uint8_t * data, uint32_t size);
+} ShimPhone;
+
+//Called at a scheduled simulated time
+typedef void (* ShimCallback)(void * data);
+
+/**
+*Receives every line the app logs
+*@param level the AppLogLevel
+*@param message the formatted log message
+*/
+typedef void (* ShimLogHandler)(uint8_t level, const char * message);
+
+/**
+*Gets the simulated time in milliseconds
+*@return milliseconds since the epoch
+*/
+uint64_t shim_now_ms();
+
+/**
+*Sets the simulated time. Only call this before anything is scheduled.
+*@param seconds seconds since the epoch
+*/
+void shim_set_time(time_t seconds);
+
+/**
+*Schedules a callback on the simulated clock. Callbacks due at the same
+*time run in the order they were scheduled.
+*@param delayMs milliseconds from now
+*@param callback the function to call
+*@param data passed to the callback
+*/
+void shim_schedule(uint32_t delayMs, ShimCallback callback, void * data);
+
+/**
+*Runs every timer and scheduled callback due up to a given time, then
+*sets the clock to that time
+*@param endMs the simulated time to stop at, in milliseconds
+*/
+void shim_run_until(uint64_t endMs);
+
+/**
+*Connects the phone side of AppMessage
+*@param phone the phone stand-in
+*/
+void shim_set_phone(const ShimPhone * phone);
+
+/**
+*Delivers a message from the phone to the watch inbox
+*@param data the message dictionary
+*@param size the dictionary size in bytes
+*@return APP_MSG_OK if the watch accepted the message, or the reason it was
+*dropped or never arrived
+*/
+AppMessageResult shim_deliver(const uint8_t * data, uint32_t size);
+
+/**
+*Connects or disconnects the phone, notifying the app if this changes
+*the connection state
+*@param connected true to connect
+*/
+void shim_set_connected(bool connected);
+
+/**
+*Limits the memory available to AppMessage buffers, so opening larger
+*buffers fails with APP_MSG_OUT_OF_MEMORY
+*@param bytes largest total inbox and outbox size, or 0 for no limit
+*/
+void shim_set_app_message_memory(uint32_t bytes);
+
+/**
+*Sets the watch battery state, notifying the app
+*@param percent the charge percentage
+*@param charging true if the watch is plugged in
+*/
+void shim_set_watch_battery(uint8_t percent, bool charging);
+
+/**
+*Simulates wrist movement, with a tap and a batch of moving accelerometer
+*samples. A still wrist is simulated by not calling this.
+*/
+void shim_move();
+
+/**
+*Sets the function that receives app log lines
+*@param handler the log handler, or NULL to discard logs
+*/
+void shim_set_log_handler(ShimLogHandler handler);
+
+/**
+*Frees everything the shim allocated
+*/
+void shim_deinit();
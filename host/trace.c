@@ -0,0 +1,120 @@
+#include <pebble.h>
+#include "trace.h"
+#include "message_protocol.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+#define MS_PER_DAY 86400000
+#define STATS_REQUEST_BIT (1 << UPDATE_TYPE_PEBBLE_STATS)
+
+//----------PUBLIC FUNCTIONS----------
+//Parses a trace line
+bool trace_parse_line(const char * text, TraceLine * line){
+  const char * start = strstr(text, "TRACE ");
+  if(start == NULL)return false;
+  long seconds;
+  int ms;
+  int consumed;
+  char event;
+  if(sscanf(start, "TRACE %ld.%d %c%n", &seconds, &ms, &event, &consumed) < 3)return false;
+  line->timeMs = (int64_t) seconds * 1000 + ms;
+  line->event = event;
+  line->numValues = 0;
+  const char * values = start + consumed;
+  int length;
+  while(line->numValues < MAX_TRACE_VALUES &&
+        sscanf(values, "%d%n", &line->values[line->numValues], &length) == 1){
+    line->numValues++;
+    values += length;
+  }
+  return true;
+}
+
+//Starts collecting statistics
+void trace_stats_init(TraceStats * stats){
+  memset(stats, 0, sizeof(TraceStats));
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++)stats->requestTimes[i] = -1;
+}
+
+//Adds one trace line to a set of statistics
+void trace_stats_add(TraceStats * stats, const TraceLine * line){
+  //Trace times are within the day, so count days across midnight
+  int64_t time = line->timeMs + (stats->lastMs / MS_PER_DAY) * MS_PER_DAY;
+  if(!stats->started){
+    stats->started = true;
+    stats->startMs = time;
+  }else if(time < stats->lastMs)time += MS_PER_DAY;
+  stats->lastMs = time;
+  const int32_t * values = line->values;
+  switch(line->event){
+    case 'o':
+      stats->opens++;
+      break;
+    case 's':
+      if(line->numValues < 3)break;
+      stats->sends++;
+      if(values[1] > 0)stats->retries++;
+      stats->bytesSent += values[2];
+      break;
+    case 'a':
+      stats->delivered++;
+      break;
+    case 'f':
+      stats->failures++;
+      break;
+    case 'x':
+      stats->dropped++;
+      break;
+    case 'r':
+      if(line->numValues < 1)break;
+      stats->received++;
+      stats->bytesReceived += values[0];
+      break;
+    case 'i':
+      stats->inboxDropped++;
+      break;
+    case 'Q':
+      if(line->numValues < 1)break;
+      for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+        if(!(values[0] & (1 << i)) || (1 << i) == STATS_REQUEST_BIT)continue;
+        stats->requests[i]++;
+        //Latency runs from the first request that wasn't answered yet
+        if(stats->requestTimes[i] < 0)stats->requestTimes[i] = time;
+      }
+      break;
+    case 'R':{
+      if(line->numValues < 1)break;
+      UpdateType type = response_type(values[0]);
+      if(type == NUM_UPDATE_TYPES || stats->requestTimes[type] < 0)break;
+      uint32_t latency = time - stats->requestTimes[type];
+      stats->requestTimes[type] = -1;
+      stats->responses[type]++;
+      stats->latencyTotal[type] += latency;
+      if(latency > stats->latencyMax[type])stats->latencyMax[type] = latency;
+      break;
+    }
+  }
+}
+
+//Gets how long a trace ran
+int64_t trace_stats_duration(const TraceStats * stats){
+  return stats->lastMs - stats->startMs;
+}
+
+//Gets the update type a message from Android responds to
+UpdateType response_type(int code){
+  switch(code){
+    case CODE_EVENT_RESPONSE:
+    case CODE_EVENTS_UNCHANGED:
+    case CODE_EVENT_DELETE:
+    case CODE_EVENT_LIST_RESPONSE:
+      return UPDATE_TYPE_EVENT;
+    case CODE_BATTERY_RESPONSE:
+      return UPDATE_TYPE_BATTERY;
+    case CODE_INFOTEXT_RESPONSE:
+      return UPDATE_TYPE_INFOTEXT;
+    case CODE_WEATHER_RESPONSE:
+      return UPDATE_TYPE_WEATHER;
+    default:
+      return NUM_UPDATE_TYPES;
+  }
+}
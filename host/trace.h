@@ -0,0 +1,79 @@
+/**
+*@File trace.h
+*Reads MESSAGING_TRACE lines, as described in messaging_core.h, and
+*collects benchmark statistics from them. The same statistics are
+*collected from a recorded trace and from a harness run, so the two
+*can be compared.
+*/
+#pragma once
+#include <pebble.h>
+#include "message_handler.h"
+
+#define MAX_TRACE_VALUES 4 //Most values logged with one trace event
+
+//One parsed trace line
+typedef struct{
+  int64_t timeMs;//milliseconds into the day the event was logged
+  char event;//trace event letter
+  int32_t values[MAX_TRACE_VALUES];//values logged with the event
+  int numValues;
+} TraceLine;
+
+//Messaging statistics collected from trace lines
+typedef struct{
+  uint32_t sends;//send attempts
+  uint32_t retries;//send attempts after the first for a message
+  uint32_t delivered;//messages acknowledged by the phone
+  uint32_t failures;//send attempts that failed
+  uint32_t dropped;//unsent messages dropped
+  uint32_t received;//messages received from the phone
+  uint32_t inboxDropped;//messages from the phone the watch dropped
+  uint32_t opens;//times AppMessage was opened
+  uint64_t bytesSent;//bytes of every send attempt
+  uint64_t bytesReceived;//bytes of every received message
+  uint32_t requests[NUM_UPDATE_TYPES];//requests sent for each update type
+  uint32_t responses[NUM_UPDATE_TYPES];//requests answered for each update type
+  uint64_t latencyTotal[NUM_UPDATE_TYPES];//summed request to response time(ms)
+  uint32_t latencyMax[NUM_UPDATE_TYPES];//longest request to response time(ms)
+  //Parsing state
+  int64_t startMs;//time of the first line, with days added across midnight
+  int64_t lastMs;//time of the last line, with days added across midnight
+  bool started;
+  int64_t requestTimes[NUM_UPDATE_TYPES];//time of each unanswered request, or -1
+} TraceStats;
+
+/**
+*Parses a trace line. Anything before "TRACE " is ignored, so lines can be
+*copied straight out of app logs.
+*@param text the log line
+*@param line set to the parsed line
+*@return true if the text held a trace line, false otherwise
+*/
+bool trace_parse_line(const char * text, TraceLine * line);
+
+/**
+*Starts collecting statistics
+*@param stats the statistics to clear
+*/
+void trace_stats_init(TraceStats * stats);
+
+/**
+*Adds one trace line to a set of statistics
+*@param stats the statistics to update
+*@param line the parsed trace line
+*/
+void trace_stats_add(TraceStats * stats, const TraceLine * line);
+
+/**
+*Gets how long a trace ran
+*@param stats statistics collected from the trace
+*@return milliseconds between the first and last line
+*/
+int64_t trace_stats_duration(const TraceStats * stats);
+
+/**
+*Gets the update type a message from Android responds to
+*@param code an AndroidMessageCode
+*@return the UpdateType, or NUM_UPDATE_TYPES if the message isn't a response
+*/
+UpdateType response_type(int code);
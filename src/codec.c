@@ -0,0 +1,167 @@
+#include <pebble.h>
+#include "codec.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+//#define DEBUG_CODEC //Uncomment to enable codec debug logging
+#define MAX_VARINT_BYTES 5 //Most bytes a 32 bit varint can take
+
+//----------STATIC FUNCTION DECLARATIONS----------
+//Each reader decodes one value of the encoding it's named for,
+//returning false if the payload is too short.
+static bool read_CODEC_U8(CodecReader * reader, uint8_t * value);
+static bool read_CODEC_U32(CodecReader * reader, uint32_t * value);
+static bool read_CODEC_VARINT(CodecReader * reader, uint32_t * value);
+static bool read_CODEC_SVARINT(CodecReader * reader, int32_t * value);
+static bool read_CODEC_COLOR(CodecReader * reader, GColor * value);
+static bool read_CODEC_STRING(CodecReader * reader, char * value);
+
+//Reads one schema field into a record
+#define CODEC_READ_FIELD(encoding, name) \
+  if(!read_##encoding(reader, CODEC_FIELD_PTR_##encoding(record->name)))return false;
+#define CODEC_FIELD_PTR_CODEC_U8(field) &(field)
+#define CODEC_FIELD_PTR_CODEC_U32(field) &(field)
+#define CODEC_FIELD_PTR_CODEC_VARINT(field) &(field)
+#define CODEC_FIELD_PTR_CODEC_SVARINT(field) &(field)
+#define CODEC_FIELD_PTR_CODEC_COLOR(field) &(field)
+#define CODEC_FIELD_PTR_CODEC_STRING(field) (field)
+
+//Defines a function that reads a record using a schema
+#define CODEC_RECORD_READER(functionName, recordType, schema) \
+  bool functionName(CodecReader * reader, recordType * record){ \
+    schema(CODEC_READ_FIELD) \
+    return true; \
+  }
+
+//----------PUBLIC FUNCTIONS----------
+
+//Starts reading a packed payload
+bool codec_begin(CodecReader * reader, const uint8_t * data, uint16_t size){
+  reader->data = data;
+  reader->size = size;
+  reader->pos = 0;
+  uint8_t version;
+  if(!read_CODEC_U8(reader, &version) || version != CODEC_VERSION){
+    APP_LOG(APP_LOG_LEVEL_ERROR,"codec_begin:Unsupported payload version");
+    return false;
+  }
+  return true;
+}
+
+//Reads the next event base time record from a payload
+CODEC_RECORD_READER(codec_read_event_base, CodecEventBase, CODEC_EVENT_BASE_SCHEMA)
+
+//Reads the next event record from a payload
+CODEC_RECORD_READER(codec_read_event, CodecEvent, CODEC_EVENT_SCHEMA)
+
+//Reads the next event list header from a payload
+CODEC_RECORD_READER(codec_read_event_list, CodecEventList, CODEC_EVENT_LIST_SCHEMA)
+
+//Reads the next weather record from a payload
+CODEC_RECORD_READER(codec_read_weather, CodecWeather, CODEC_WEATHER_SCHEMA)
+
+//Reads the next forecast header from a payload
+CODEC_RECORD_READER(codec_read_forecast, CodecForecast, CODEC_FORECAST_SCHEMA)
+
+//Reads the next interval scale record from a payload
+CODEC_RECORD_READER(codec_read_interval_scale, CodecIntervalScale, CODEC_INTERVAL_SCALE_SCHEMA)
+
+//Reads the next update bounds record from a payload
+CODEC_RECORD_READER(codec_read_update_bounds, CodecUpdateBounds, CODEC_UPDATE_BOUNDS_SCHEMA)
+
+//Reads the next color record from a payload
+CODEC_RECORD_READER(codec_read_colors, CodecColors, CODEC_COLORS_SCHEMA)
+
+//Reads the next settings record from a payload
+CODEC_RECORD_READER(codec_read_settings, CodecSettings, CODEC_SETTINGS_SCHEMA)
+
+//Reads the next battery record from a payload
+CODEC_RECORD_READER(codec_read_battery, CodecBattery, CODEC_BATTERY_SCHEMA)
+
+//----------STATIC FUNCTIONS----------
+
+/**
+*Reads a single byte
+*@param reader the payload reader
+*@param value set to the byte read
+*@return true on success, false if the payload ended
+*/
+static bool read_CODEC_U8(CodecReader * reader, uint8_t * value){
+  if(reader->pos >= reader->size)return false;
+  *value = reader->data[reader->pos++];
+  return true;
+}
+
+/**
+*Reads a little-endian 32 bit value
+*@param reader the payload reader
+*@param value set to the value read
+*@return true on success, false if the payload ended
+*/
+static bool read_CODEC_U32(CodecReader * reader, uint32_t * value){
+  if(reader->pos + 4 > reader->size)return false;
+  const uint8_t * bytes = reader->data + reader->pos;
+  *value = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | ((uint32_t) bytes[3] << 24);
+  reader->pos += 4;
+  return true;
+}
+
+/**
+*Reads an unsigned varint
+*@param reader the payload reader
+*@param value set to the value read
+*@return true on success, false if the payload ended or the
+*varint was too long
+*/
+static bool read_CODEC_VARINT(CodecReader * reader, uint32_t * value){
+  *value = 0;
+  for(int i = 0; i < MAX_VARINT_BYTES; i++){
+    uint8_t byte;
+    if(!read_CODEC_U8(reader, &byte))return false;
+    *value |= (uint32_t)(byte & 0x7F) << (7 * i);
+    if(!(byte & 0x80))return true;
+  }
+  #ifdef DEBUG_CODEC
+  APP_LOG(APP_LOG_LEVEL_ERROR,"read_CODEC_VARINT:Varint is too long");
+  #endif
+  return false;
+}
+
+/**
+*Reads a zigzag encoded signed varint
+*@param reader the payload reader
+*@param value set to the value read
+*@return true on success, false if the payload ended
+*/
+static bool read_CODEC_SVARINT(CodecReader * reader, int32_t * value){
+  uint32_t zigzag;
+  if(!read_CODEC_VARINT(reader, &zigzag))return false;
+  *value = (int32_t)(zigzag >> 1) ^ -(int32_t)(zigzag & 1);
+  return true;
+}
+
+/**
+*Reads a GColor8 byte
+*@param reader the payload reader
+*@param value set to the color read
+*@return true on success, false if the payload ended
+*/
+static bool read_CODEC_COLOR(CodecReader * reader, GColor * value){
+  return read_CODEC_U8(reader, &value->argb);
+}
+
+/**
+*Reads a length-prefixed string, truncating it to CODEC_MAX_STRING - 1 characters
+*@param reader the payload reader
+*@param value a buffer of at least CODEC_MAX_STRING bytes, set to the
+*null-terminated string read
+*@return true on success, false if the payload ended
+*/
+static bool read_CODEC_STRING(CodecReader * reader, char * value){
+  uint8_t length;
+  if(!read_CODEC_U8(reader, &length) || reader->pos + length > reader->size)return false;
+  uint8_t copyLength = length < CODEC_MAX_STRING ? length : CODEC_MAX_STRING - 1;
+  memcpy(value, reader->data + reader->pos, copyLength);
+  value[copyLength] = '\0';
+  reader->pos += length;
+  return true;
+}
@@ -0,0 +1,226 @@
+/**
+*@File codec.h
+*Reads the packed binary payloads sent by the companion app.
+*Each payload is a byte array starting with CODEC_VERSION, followed by
+*records laid out as defined by the schemas below.
+*/
+#pragma once
+#include <pebble.h>
+
+#define CODEC_VERSION 2 //Version byte at the start of every packed payload
+#define CODEC_MAX_STRING 64 //Largest decoded string size, including the null terminator
+
+//Value encodings used in payload records
+typedef enum{
+  CODEC_U8,
+    //one byte
+  CODEC_U32,
+    //four bytes, little-endian
+  CODEC_VARINT,
+    //unsigned LEB128 varint: seven bits per byte, lowest bits first,
+    //high bit set on every byte but the last. At most five bytes.
+  CODEC_SVARINT,
+    //signed value, zigzag encoded as ((n << 1) ^ (n >> 31)) then written as a CODEC_VARINT
+  CODEC_COLOR,
+    //one GColor8 argb byte, where 0(GColorClear) means no color
+  CODEC_STRING
+    //one length byte, followed by that many bytes of text with no null terminator
+} CodecEncoding;
+
+//----------PAYLOAD SCHEMAS----------
+//Each schema lists a record's fields in order as X(encoding, name).
+//The companion app's codec is built from the same lists.
+
+//Base time for the event records in a payload. Event payloads start with
+//one base record, so each event start only holds its distance from the base.
+//Sending the start of the current hour as the base keeps near events' starts
+//to three bytes or less.
+#define CODEC_EVENT_BASE_SCHEMA(X) \
+  X(CODEC_U32, base) /*time event starts are relative to*/
+
+//A single event
+#define CODEC_EVENT_SCHEMA(X) \
+  X(CODEC_U8, num) /*event slot*/ \
+  X(CODEC_U32, id) /*companion app event ID, or 0*/ \
+  X(CODEC_SVARINT, start) /*seconds from the payload's base time to the start time*/ \
+  X(CODEC_VARINT, duration) /*seconds from start to end*/ \
+  X(CODEC_COLOR, color) \
+  X(CODEC_STRING, title)
+
+//Header for one part of an event list. A full event list may be split over
+//several messages, each holding a base record and a header followed by
+//count event records.
+//Event slots missing from a complete list are cleared.
+#define CODEC_EVENT_LIST_SCHEMA(X) \
+  X(CODEC_U8, part) /*index of this part, starting at 0*/ \
+  X(CODEC_U8, numParts) /*total number of parts in the list*/ \
+  X(CODEC_U8, count) /*number of event records in this part*/
+
+//Current weather
+#define CODEC_WEATHER_SCHEMA(X) \
+  X(CODEC_SVARINT, temperature) \
+  X(CODEC_VARINT, condition) /*OpenWeatherAPI condition code*/
+
+//Weather forecast header, followed by count CODEC_WEATHER_SCHEMA records
+//for consecutive slots. Temperatures within 63 degrees of zero and
+//condition codes below 16384 keep each slot record to three bytes.
+#define CODEC_FORECAST_SCHEMA(X) \
+  X(CODEC_VARINT, start) /*time the first slot begins*/ \
+  X(CODEC_VARINT, slotLength) /*seconds covered by each slot*/ \
+  X(CODEC_U8, count) /*number of slot records that follow*/
+
+//Update interval scale for one update type within one watch battery band.
+//Scale payloads hold one record per update type for each battery band,
+//band by band. Scales below 16384 keep each record to two bytes.
+#define CODEC_INTERVAL_SCALE_SCHEMA(X) \
+  X(CODEC_VARINT, percent) /*percentage of the update frequency to wait between updates*/
+
+//Adaptive update interval bounds for one update type. Bounds payloads hold
+//one record per update type, in UpdateType order. Zero bounds use defaults.
+#define CODEC_UPDATE_BOUNDS_SCHEMA(X) \
+  X(CODEC_VARINT, minFreq) /*shortest update interval(seconds)*/ \
+  X(CODEC_VARINT, maxFreq) /*longest update interval(seconds)*/
+
+//Display theme and colors, in ColorID order. A theme of CODEC_NO_THEME
+//or a color of GColorClear leaves that value unchanged.
+#define CODEC_COLORS_SCHEMA(X) \
+  X(CODEC_U8, theme) \
+  X(CODEC_COLOR, background) \
+  X(CODEC_COLOR, foreground) \
+  X(CODEC_COLOR, line) \
+  X(CODEC_COLOR, text) \
+  X(CODEC_COLOR, event0) \
+  X(CODEC_COLOR, event1)
+#define CODEC_NO_THEME 0xFF
+
+//Display settings
+#define CODEC_SETTINGS_SCHEMA(X) \
+  X(CODEC_U8, futureEventTimeFormat) /*FutureEventFormat value*/ \
+  X(CODEC_STRING, dateFormat) /*strftime date format*/
+
+//Phone battery state
+#define CODEC_BATTERY_SCHEMA(X) \
+  X(CODEC_U8, percent) \
+  X(CODEC_U8, charging) /*1 if charging, 0 otherwise*/
+
+//----------DECODED RECORD TYPES----------
+#define CODEC_CTYPE_CODEC_U8 uint8_t
+#define CODEC_CTYPE_CODEC_U32 uint32_t
+#define CODEC_CTYPE_CODEC_VARINT uint32_t
+#define CODEC_CTYPE_CODEC_SVARINT int32_t
+#define CODEC_CTYPE_CODEC_COLOR GColor
+#define CODEC_CTYPE_CODEC_STRING char
+#define CODEC_ARRAY_CODEC_U8
+#define CODEC_ARRAY_CODEC_U32
+#define CODEC_ARRAY_CODEC_VARINT
+#define CODEC_ARRAY_CODEC_SVARINT
+#define CODEC_ARRAY_CODEC_COLOR
+#define CODEC_ARRAY_CODEC_STRING [CODEC_MAX_STRING]
+#define CODEC_STRUCT_FIELD(encoding, name) CODEC_CTYPE_##encoding name CODEC_ARRAY_##encoding;
+
+typedef struct{ CODEC_EVENT_BASE_SCHEMA(CODEC_STRUCT_FIELD) } CodecEventBase;
+typedef struct{ CODEC_EVENT_SCHEMA(CODEC_STRUCT_FIELD) } CodecEvent;
+typedef struct{ CODEC_EVENT_LIST_SCHEMA(CODEC_STRUCT_FIELD) } CodecEventList;
+typedef struct{ CODEC_WEATHER_SCHEMA(CODEC_STRUCT_FIELD) } CodecWeather;
+typedef struct{ CODEC_FORECAST_SCHEMA(CODEC_STRUCT_FIELD) } CodecForecast;
+typedef struct{ CODEC_INTERVAL_SCALE_SCHEMA(CODEC_STRUCT_FIELD) } CodecIntervalScale;
+typedef struct{ CODEC_UPDATE_BOUNDS_SCHEMA(CODEC_STRUCT_FIELD) } CodecUpdateBounds;
+typedef struct{ CODEC_COLORS_SCHEMA(CODEC_STRUCT_FIELD) } CodecColors;
+typedef struct{ CODEC_SETTINGS_SCHEMA(CODEC_STRUCT_FIELD) } CodecSettings;
+typedef struct{ CODEC_BATTERY_SCHEMA(CODEC_STRUCT_FIELD) } CodecBattery;
+
+//Reading position within a packed payload
+typedef struct{
+  const uint8_t * data;
+  uint16_t size;
+  uint16_t pos;
+} CodecReader;
+
+/**
+*Starts reading a packed payload
+*@param reader the reader to initialize
+*@param data the payload bytes
+*@param size the payload size in bytes
+*@return true if the payload has a supported version, false otherwise
+*/
+bool codec_begin(CodecReader * reader, const uint8_t * data, uint16_t size);
+
+/**
+*Reads the next event base time record from a payload
+*@param reader a reader set up with codec_begin
+*@param base the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_event_base(CodecReader * reader, CodecEventBase * base);
+
+/**
+*Reads the next event record from a payload
+*@param reader a reader set up with codec_begin
+*@param event the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_event(CodecReader * reader, CodecEvent * event);
+
+/**
+*Reads the next event list header from a payload
+*@param reader a reader set up with codec_begin
+*@param list the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_event_list(CodecReader * reader, CodecEventList * list);
+
+/**
+*Reads the next weather record from a payload
+*@param reader a reader set up with codec_begin
+*@param weather the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_weather(CodecReader * reader, CodecWeather * weather);
+
+/**
+*Reads the next forecast header from a payload
+*@param reader a reader set up with codec_begin
+*@param forecast the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_forecast(CodecReader * reader, CodecForecast * forecast);
+
+/**
+*Reads the next interval scale record from a payload
+*@param reader a reader set up with codec_begin
+*@param scale the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_interval_scale(CodecReader * reader, CodecIntervalScale * scale);
+
+/**
+*Reads the next update bounds record from a payload
+*@param reader a reader set up with codec_begin
+*@param bounds the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_update_bounds(CodecReader * reader, CodecUpdateBounds * bounds);
+
+/**
+*Reads the next color record from a payload
+*@param reader a reader set up with codec_begin
+*@param colors the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_colors(CodecReader * reader, CodecColors * colors);
+
+/**
+*Reads the next settings record from a payload
+*@param reader a reader set up with codec_begin
+*@param settings the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_settings(CodecReader * reader, CodecSettings * settings);
+
+/**
+*Reads the next battery record from a payload
+*@param reader a reader set up with codec_begin
+*@param battery the record to fill
+*@return true on success, false if the payload ended early
+*/
+bool codec_read_battery(CodecReader * reader, CodecBattery * battery);
@@ -64,8 +64,8 @@ void memDebug(char * string){
 void setPreview1(){
   time_t now = time(NULL);
   update_text("84%",TEXT_PHONE_BATTERY);
-  add_event(0,"Work",now - 14600,now+23530,"FF0000");
-  add_event(1,"Sleep",now + 999560,now+1000000,"FFFF00");
+  add_event(0,0,"Work",now - 14600,now+23530,GColorFromHEX(0xFF0000));
+  add_event(1,0,"Sleep",now + 999560,now+1000000,GColorFromHEX(0xFFFF00));
   update_weather(30,808);
   update_text("Cloudy",TEXT_INFOTEXT);
 }
@@ -77,6 +77,6 @@ void setPreview2(){
   update_text("84%",TEXT_PHONE_BATTERY);
   update_text("25 Unread",TEXT_INFOTEXT);
   update_weather(55,508);
-  add_event(0,"School",now - 14600,now+2353,"0000FF");
-  add_event(1,"Movie",now + 9995,now+10000,"00FF00");
+  add_event(0,0,"School",now - 14600,now+2353,GColorFromHEX(0x0000FF));
+  add_event(1,0,"Movie",now + 9995,now+10000,GColorFromHEX(0x00FF00));
 }
\ No newline at end of file
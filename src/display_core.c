@@ -37,12 +37,16 @@ static int numDisplayStrings = 0;
 
 static int themeResID = 0;
 static int themeID = 0;
+static int numThemeLayers = 0;//Number of layers defined by the current theme
+
+static LayerDrawFunction drawFunctions[NUM_LAYERS] = {NULL};
+  //Extra drawing functions for image layers
 
 //----------STATIC FUNCTION DECLARATIONS----------
 //Initialization functions:
 static void load_colors();
   //Load saved or default display colors
-static void load_text(int16_t layerIndices[NUM_LAYERS]);
+static void load_text(int16_t layerIndices[NUM_LAYERS], int numLayers);
   //Initialize display strings and load saved display text
 static TextLayer * init_text_layer(GRect bounds,char * text,GFont font,GTextAlignment align,int marginHeight);
   //Creates a text layer with the given parameters, and adds it to the main window
@@ -60,8 +64,6 @@ static void background_update_callback(Layer *layer, GContext *ctx);
   //Fills the background with the background color
 static void gcolor_to_hex_string(char outstring[7], GColor color);
   //Given a GColor, copy its hex value into a buffer string
-static GColor hex_string_to_gcolor(char * string);
-  //Given a color hex string, return a corresponding GColor
 
 //----------PUBLIC FUNCTIONS----------
 //initializes all display functionality
@@ -94,14 +96,20 @@ void display_create(int themeResource,int theme ,int fontIDs[],int fontMargins[]
   #ifdef DEBUG_DISPLAY
   APP_LOG(APP_LOG_LEVEL_DEBUG,"display_create:Found numLayers = %d",(int)numLayers);
   #endif
+  if(numLayers > NUM_LAYERS)numLayers = NUM_LAYERS;
+  numThemeLayers = numLayers;
   int16_t layerIndices [NUM_LAYERS];
   resource_load_byte_range(themeRes, index, (uint8_t *)layerIndices, sizeof(int16_t) * numLayers);
   
-  load_text(layerIndices);
+  load_text(layerIndices, numLayers);
   int textLayerNum = 0;//for assigning strings to text layers
-  //create each layer
+  //create each layer, optional layers the theme doesn't define are left empty
   if(displayLayers == NULL){
-    displayLayers = malloc(sizeof(DisplayLayer) * numLayers);
+    displayLayers = malloc(sizeof(DisplayLayer) * NUM_LAYERS);
+  }
+  for(int i = numLayers; i < NUM_LAYERS; i++){
+    displayLayers[i].layer = NULL;
+    displayLayers[i].type = IMAGE_LAYER_TYPE;
   }
   for(int i = 0; i < numLayers; i++){
      #ifdef DEBUG_DISPLAY
@@ -191,6 +199,7 @@ void display_destroy(){
     displayStrings = NULL;
   }
   numDisplayStrings = 0;
+  numThemeLayers = 0;
   //Unload Layers
   for(int i=0;i<NUM_LAYERS;i++){
     if(displayLayers[i].layer != NULL){
@@ -247,16 +256,36 @@ void update_display_text(char * newText, LayerID textID){
 
 //update one of the color values
 void update_color(char colorString[7], ColorID colorID){
+  set_color(hex_string_to_gcolor(colorString), colorID);
+}
+
+//set one of the color values
+void set_color(GColor color, ColorID colorID){
   if(!initialized){
     #ifdef DEBUG_DISPLAY
-    APP_LOG(APP_LOG_LEVEL_DEBUG,"update_color:Display not initialized!");
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"set_color:Display not initialized!");
     #endif
     return;
   } 
-  colors[colorID] = hex_string_to_gcolor(colorString);
+  if(gcolor_equal(colors[colorID], color))return;//skip redrawing unchanged colors
+  colors[colorID] = color;
   apply_colors();
 }
 
+//set a function for drawing extra content on an image layer
+void set_layer_draw_function(LayerID layerID, LayerDrawFunction drawFunction){
+  drawFunctions[layerID] = drawFunction;
+}
+
+//Redraws a display layer
+void redraw_layer(LayerID layerID){
+  if(!initialized || displayLayers[layerID].layer == NULL)return;
+  if(displayLayers[layerID].type == TEXT_LAYER_TYPE){
+    layer_mark_dirty(text_layer_get_layer((TextLayer *) displayLayers[layerID].layer));
+  }
+  else layer_mark_dirty(displayLayers[layerID].layer);
+}
+
 //Get the default frame of a display object
 GRect get_default_frame(int layerID){
   if(!initialized){
@@ -265,6 +294,7 @@ GRect get_default_frame(int layerID){
     #endif
     return GRect(0,0,0,0);
   }
+  if(layerID >= numThemeLayers)return GRect(0,0,0,0);//layer isn't in this theme
   ResHandle themeRes = resource_get_handle(themeResID);
   int metaIndex = 2 + NUM_COLORS*6 + layerID*2;
   int16_t index;
@@ -283,6 +313,7 @@ GRect get_bounds(int layerID){
     #endif
     return GRect(0,0,0,0);
   }
+  if(displayLayers[layerID].layer == NULL)return GRect(0,0,0,0);//layer isn't in this theme
   switch(displayLayers[layerID].type){
     case TEXT_LAYER_TYPE:
       return layer_get_bounds(text_layer_get_layer(
@@ -305,6 +336,7 @@ GRect get_frame(int layerID){
     #endif
     return GRect(0,0,0,0);
   }
+  if(displayLayers[layerID].layer == NULL)return GRect(0,0,0,0);//layer isn't in this theme
   switch(displayLayers[layerID].type){
     case TEXT_LAYER_TYPE:
       return layer_get_frame(text_layer_get_layer(
@@ -327,6 +359,7 @@ void set_bounds(GRect bounds, LayerID layerID){
     #endif
     return;
   }
+  if(displayLayers[layerID].layer == NULL)return;//layer isn't in this theme
   switch(displayLayers[layerID].type){
     case TEXT_LAYER_TYPE:
       layer_set_bounds(text_layer_get_layer(
@@ -345,6 +378,7 @@ void set_frame(GRect frame, LayerID layerID){
     #endif
     return;
   }
+  if(displayLayers[layerID].layer == NULL)return;//layer isn't in this theme
   switch(displayLayers[layerID].type){
     case TEXT_LAYER_TYPE:
       layer_set_frame(text_layer_get_layer(
@@ -381,9 +415,9 @@ static void load_colors(){
 }
 
 //Initialize strings
-static void load_text(int16_t layerIndices[NUM_LAYERS]){
+static void load_text(int16_t layerIndices[NUM_LAYERS], int numLayers){
   ResHandle themeRes = resource_get_handle(themeResID);
-  for(int i = 0; i < NUM_LAYERS; i++){
+  for(int i = 0; i < numLayers; i++){
     int8_t layerType;
     resource_load_byte_range(themeRes,layerIndices[i], (uint8_t *)&layerType, 1);
     if(layerType == TEXT_LAYER_TYPE)numDisplayStrings++;
@@ -480,8 +514,9 @@ static void apply_colors(){
     APP_LOG(APP_LOG_LEVEL_DEBUG,"apply_colors:Updating layer colors");
   #endif
   for(int i = 0; i < NUM_LAYERS; i++){
-    if(displayLayers[i].layer == NULL)
-      APP_LOG(APP_LOG_LEVEL_ERROR,"apply_colors: layer is null!");
+    if(displayLayers[i].layer == NULL){
+      if(i < numThemeLayers)APP_LOG(APP_LOG_LEVEL_ERROR,"apply_colors: layer is null!");
+    }
     else{
       if(displayLayers[i].type == TEXT_LAYER_TYPE){
         text_layer_set_text_color((TextLayer *) displayLayers[i].layer,
@@ -525,6 +560,7 @@ static void image_update_callback(Layer *layer, GContext *ctx){
         //#endif
         graphics_fill_rect(ctx,GRect(rect[0],rect[1],rect[2],rect[3]),0,GCornersAll);
       }
+      if(drawFunctions[i] != NULL)drawFunctions[i](ctx, layer_get_bounds(layer));
     }
   }
 }
@@ -576,24 +612,3 @@ static void gcolor_to_hex_string(char outstring[7], GColor color){
   }
   outstring[6] = '\0';
 }
-
-/**
-*Given a GColor, copies its hex value into a buffer string
-*@param outstring a buffer of at least size 7
-*@param color the GColor to convert to a string
-*/
-static GColor hex_string_to_gcolor(char * string){
-  int color,base,i;
-  color = 0;
-  base = 1;
-  for(i=1;i<=6;i++){
-      char iChar = string[6-i];
-      if(('a' <= iChar) && (iChar <= 'f')) color += ((int) iChar - 'a' + 10) * base;
-      else if(('A' <= iChar) && (iChar <= 'F')) color += ((int) iChar - 'A' + 10) * base;
-      else if(('0' <= iChar) && (iChar <= '9')) color += ((int) iChar - '0') * base;  
-      base *= 16;
-    }
-  GColor gcolor = GColorFromHEX(color);
-  return gcolor;
-}
-
@@ -8,6 +8,13 @@
 #include "pebble.h"
 #include "display_elements.h" 
 
+/**
+*Draws extra content on an image layer, after its theme rectangles
+*@param ctx the graphics context, with fill color set to the layer color
+*@param bounds the layer bounds
+*/
+typedef void (* LayerDrawFunction)(GContext * ctx, GRect bounds);
+
 /**
 *initializes all display functionality
 *@param themeResource the theme resource ID
@@ -36,7 +43,26 @@ void update_display_text(char * newText, LayerID textID);
 */
 void update_color(char colorString[7], ColorID colorID);
 
+/**
+*set one of the color values
+*@param color the new color
+*@param colorID the ID of the color to update
+*/
+void set_color(GColor color, ColorID colorID);
+
 
+/**
+*set a function for drawing extra content on an image layer
+*@param layerID the image layer's ID
+*@param drawFunction the drawing function, or NULL to only draw theme rectangles
+*/
+void set_layer_draw_function(LayerID layerID, LayerDrawFunction drawFunction);
+
+/**
+*Redraws a display layer
+*@param layerID the layer's ID
+*/
+void redraw_layer(LayerID layerID);
 
 /**
 *Get the default bounds of a display layer
@@ -20,8 +20,9 @@ typedef enum{
   IMAGE_LAYER_DAY_PROGRESS,//day progress bar
   IMAGE_LAYER_EVENT_0_PROGRESS, //first event progress bar
   IMAGE_LAYER_EVENT_1_PROGRESS, //second event progress bar
+  IMAGE_LAYER_DAY_OVERVIEW, //optional busy time strip for the current day
 }LayerID;
-#define NUM_LAYERS 14
+#define NUM_LAYERS 15
 
 //Font resource index
 typedef enum{
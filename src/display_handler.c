@@ -1,6 +1,7 @@
 #include <pebble.h>
 #include "display_handler.h"
 #include "display_core.h"
+#include "events.h"
 #include "storage_keys.h"
 #include "util.h"
 #include "debug.h"
@@ -19,16 +20,21 @@ int weatherCondition = 0;//weather condition code
 
 Theme displayTheme = THEME_CORINTHIAN;//watch theme
 
+static uint8_t busySlots[BUSY_SLOT_BYTES] = {0};//displayed day overview slots
+
 //----------STATIC FUNCTION DECLARATIONS----------
 static void update_progress(LayerID progressID,int percent);
   //Re-sizes a progress bar
 static void update_weather_condition();
   //Updates weather condition display
+static void draw_day_overview(GContext * ctx, GRect bounds);
+  //Draws busy time slots on the day overview layer
 
 
 //----------PUBLIC FUNCTIONS----------
 //initializes all display functionality
 void display_init(){
+  set_layer_draw_function(IMAGE_LAYER_DAY_OVERVIEW, draw_day_overview);
   if(persist_exists(PERSIST_KEY_THEME))
     displayTheme =  persist_read_int(PERSIST_KEY_THEME);
   set_theme(displayTheme);
@@ -92,7 +98,7 @@ void set_theme(Theme theme){
 
 //Updates display data for events
 void update_event_display(int eventNum, char * event_title, char * event_time,
-                          int eventPercent, char * event_color){
+                          int eventPercent, GColor event_color){
   #ifdef DEBUG_DISPLAY
   APP_LOG(APP_LOG_LEVEL_DEBUG,"update_event_display: starting update");
   #endif
@@ -114,9 +120,9 @@ void update_event_display(int eventNum, char * event_title, char * event_time,
   //set progress bar color if display is in color
   #ifdef PBL_COLOR
   #ifdef DEBUG_DISPLAY
-  APP_LOG(APP_LOG_LEVEL_DEBUG,"update_event_display:Setting progress bar color to %s",event_color);
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"update_event_display:Setting progress bar color to %d",event_color.argb);
   #endif
-  update_color(event_color,eventNum == 0 ? EVENT_0_COLOR : EVENT_1_COLOR);
+  set_color(event_color,eventNum == 0 ? EVENT_0_COLOR : EVENT_1_COLOR);
   #endif
 }
 
@@ -167,6 +173,13 @@ void update_weather(int degrees, int condition){
   update_weather_condition();
 }
 
+//Updates the day overview strip
+void update_day_overview(const uint8_t * slots){
+  if(memcmp(busySlots, slots, sizeof(busySlots)) == 0)return;//nothing to redraw
+  memcpy(busySlots, slots, sizeof(busySlots));
+  redraw_layer(IMAGE_LAYER_DAY_OVERVIEW);
+}
+
 /**
 *change non-event color values to the ones stored in a color array
 *@param colorArray an array of NUM_COLOR color strings,
@@ -184,6 +197,21 @@ void update_colors(char colorArray[NUM_COLORS][7]){
   #endif
 }
 
+//change color values to the ones stored in a GColor array
+void update_gcolors(GColor colorArray[]){
+  for(int i = 0; i < NUM_COLORS; i++){
+    if(!gcolor_equal(colorArray[i], GColorClear)){
+      set_color(colorArray[i],i);
+    }
+  }
+  #ifdef PBL_BW//if monochrome, make sure progress bars are set to text color 
+  if(!gcolor_equal(colorArray[TEXT_COLOR], GColorClear)){
+    set_color(colorArray[TEXT_COLOR],EVENT_0_COLOR);
+    set_color(colorArray[TEXT_COLOR],EVENT_1_COLOR);
+  }
+  #endif
+}
+
 //Directly updates display text
 void update_text(char * newText, DisplayTextType textType){
   #ifdef DEBUG_DISPLAY
@@ -287,4 +315,34 @@ static void update_weather_condition(){
     }
   }
   
-}
\ No newline at end of file
+}
+
+/**
+*Draws busy time slots on the day overview layer
+*Each run of consecutive busy slots is drawn as one rectangle
+*@param ctx the graphics context
+*@param bounds the layer bounds
+*/
+static void draw_day_overview(GContext * ctx, GRect bounds){
+  int slot = 0;
+  while(slot < NUM_BUSY_SLOTS){
+    uint8_t slotByte = busySlots[slot / 8];
+    if(slot % 8 == 0 && slotByte == 0){//skip empty bytes
+      slot += 8;
+      continue;
+    }
+    if(!(slotByte & (1 << (slot % 8)))){
+      slot++;
+      continue;
+    }
+    int runStart = slot;
+    while(slot < NUM_BUSY_SLOTS && (busySlots[slot / 8] & (1 << (slot % 8)))){
+      if(slot % 8 == 0 && busySlots[slot / 8] == 0xFF) slot += 8;//skip full bytes
+      else slot++;
+    }
+    int x = runStart * bounds.size.w / NUM_BUSY_SLOTS;
+    int w = slot * bounds.size.w / NUM_BUSY_SLOTS - x;
+    if(w < 1) w = 1;//always show short events
+    graphics_fill_rect(ctx, GRect(bounds.origin.x + x, bounds.origin.y, w, bounds.size.h), 0, GCornerNone);
+  }
+}
@@ -37,7 +37,7 @@ void set_theme(Theme theme);
 *@param event_color the event's display color
 */
 void update_event_display(int eventNum, char * event_title, 
-                          char * event_time, int eventPercent, char * event_color);
+                          char * event_time, int eventPercent, GColor event_color);
 
 /**
 *Sets the displayed time and date
@@ -45,6 +45,12 @@ void update_event_display(int eventNum, char * event_title,
 */
 void set_time(time_t newTime);
 
+/**
+*Updates the day overview strip, if the theme includes one
+*@param slots busy time slot bitset, as returned by get_busy_slots()
+*/
+void update_day_overview(const uint8_t * slots);
+
 /**
 *Updates weather display
 *@param degrees the temperature
@@ -60,6 +66,13 @@ void update_weather(int degrees, int condition);
 */
 void update_colors(char colorArray[][7]);
 
+/**
+*change color values to the ones stored in a GColor array
+*@param colorArray an array of NUM_COLORS colors. GColorClear
+*can be used to indicate that a color won't be changed
+*/
+void update_gcolors(GColor colorArray[]);
+
 //defines types of display text that can be directly set
 typedef enum{
   TEXT_PHONE_BATTERY,//phone battery percentage
@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <stddef.h>
 #include "events.h"
 #include "message_handler.h"
 #include "util.h"
@@ -9,140 +10,282 @@
 
 //----------LOCAL VALUE DEFINITIONS----------
 //#define DEBUG_EVENTS  //uncomment to enable event debug logging
+#define EVENT_DATA_VERSION 6 //Saved event data format, change whenever eventData changes
+#define TITLE_POOL_SIZE (1 + NUM_EVENTS * MAX_EVENT_LENGTH)
+  //Bytes available for storing unique event titles, enough for the empty
+  //title and a full length title for every event
+#if TITLE_POOL_SIZE > UINT8_MAX
+#error "Title pool offsets and poolSize are stored as uint8_t"
+#endif
+#define EMPTY_TITLE 0 //Title pool offset of the empty string
+#define SAVE_DELAY 60000 //Milliseconds to collect event changes before saving them
+#define REMINDER_LEAD_TIME 300 //Seconds before an event starts to vibrate a reminder
+#define MAX_WAKEUPS 8 //Maximum number of wakeups an app may schedule at once
+#define WAKEUP_SPACING 60 //Minimum seconds allowed between scheduled wakeups
+#define NUM_REMINDERS (NUM_EVENTS < MAX_WAKEUPS ? NUM_EVENTS : MAX_WAKEUPS)
+  //Maximum number of reminders scheduled at once
+#define BUSY_SLOT_LENGTH (SECONDS_PER_DAY / NUM_BUSY_SLOTS) //Seconds covered by each busy slot
 
 //----------EVENT DATA STRUCTURE----------
 struct eventStruct{
-  char title[MAX_EVENT_LENGTH];//event title
+  uint32_t id;//event ID assigned by the companion app, or 0 if not set
   long start;//event start time (seconds)
   long end;//event end time (seconds)
-  char color[7];//event display color
+  uint8_t title;//offset of the event title in the title pool
+  uint8_t color;//event display color, as a GColor8 argb value
+};
+
+//All stored event data, saved to persistent storage as a single block
+struct eventData{
+  uint32_t checksum;//FNV-1a hash of all following saved data
+  uint8_t version;//saved data format, equal to EVENT_DATA_VERSION
+  uint8_t poolSize;//number of title pool bytes in use
+  struct eventStruct events[NUM_EVENTS];//event records
+  char titlePool[TITLE_POOL_SIZE];//null-terminated event titles, stored back to back
 };
 
 //----------LOCAL VARIABLES----------
-struct eventStruct events[NUM_EVENTS] = {{"------",0,0,"000000"}};//event data array
+static struct eventData eventData = {
+  .version = EVENT_DATA_VERSION,
+  .poolSize = 8,
+  .events = {{0,0,0,1,GColorBlackARGB8}},
+  .titlePool = "\0------"
+};//event data, the pool always begins with the empty title
+static struct eventStruct * const events = eventData.events;//event data array
 int events_initialized = 0;//Equals 1 iff events_init has been run
+static uint32_t eventSetHash = 0;//Hash of all stored event data
+static bool eventSetHashValid = false;//false if events changed since eventSetHash was found
+static bool eventsDirty = false;//true if event data changed since the last save
+static uint32_t savedChecksum = 0;//Checksum of the event data in persistent storage
+static AppTimer * saveTimer = NULL;//Timer for saving changed event data
+static int updateDepth = 0;//Number of events_begin_update calls not yet ended
+static bool updateChanged = false;//true if events changed since events_begin_update
+static EventsChangedHandler changedHandler = NULL;//Function to notify of event changes
+static time_t reminderTimes[NUM_REMINDERS] = {0};//Scheduled reminder wakeup times, earliest first
+static struct{
+  time_t dayStart;//midnight at the start of the day the slots cover
+  uint8_t slots[BUSY_SLOT_BYTES];//busy time slot bitset
+} busyDay = {0,{0}};//busy time slots for the current day
 FutureEventFormat futureEventFormat = TIME_REMAINING_ONLY;
 //Time display format for upcoming events
 
+//----------STATIC FUNCTION DECLARATIONS----------
+static size_t event_data_size(struct eventData * data);
+  //Gets the number of bytes of event data that need to be saved
+static int find_title(char * pool, int poolSize, char * title, size_t length);
+  //Finds a title within a title pool
+static uint8_t intern_title(char * title);
+  //Gets a title's offset in the title pool, adding it if necessary
+static void compact_title_pool();
+  //Removes all titles no longer used by an event from the title pool
+static void schedule_save();
+  //Saves event data after SAVE_DELAY, unless a save is already scheduled
+static void save_timer_callback(void * data);
+  //Saves changed event data when the save timer runs out
+static void save_events();
+  //Saves changed event data to persistent storage
+static uint32_t event_data_checksum();
+  //Calculates the checksum of all saved event data
+static void clear_event(int numEvent);
+  //Removes an event from its event slot
+static void plan_reminders();
+  //Schedules reminder wakeups for upcoming events
+static void reminder_handler(WakeupId wakeupID, int32_t cookie);
+  //Vibrates to remind the user of an upcoming event
+static bool is_pending(int numEvent);
+  //Checks if an event slot holds an event that hasn't ended
+static void mark_busy_slots(int numEvent);
+  //Marks the busy slots covered by an event
+static void rebuild_busy_slots();
+  //Recalculates busy slots from the current time onward
+static void events_changed(int numEvent);
+  //Updates everything depending on stored events after they change
+
 //----------PUBLIC FUNCTIONS----------
 //initializes event functionality 
 void events_init(){
   if(!events_initialized){
-    int numKeys, i;
-    size_t lastKeySize;
-    struct eventStruct * index;
-    bool readSuccess = true;
+    struct eventData loaded;
+    uint8_t * index = (uint8_t *) &loaded;
+    size_t bytesLoaded = 0;
+    size_t expectedSize = sizeof(loaded);
+    int i;
     
-    //Load stored event data 
-    //Find number of event keys to read
-    numKeys =  sizeof(events)/PERSIST_DATA_MAX_LENGTH;
-    lastKeySize =  sizeof(events) % PERSIST_DATA_MAX_LENGTH;
-    if(lastKeySize > 0)numKeys++;
-    else lastKeySize = PERSIST_DATA_MAX_LENGTH;
-    #ifdef DEBUG_EVENTS
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"Loading event data as %d keys",numKeys+1);
-    #endif
-    //Load events from storage
-    index = events;
-    for(i = 0;i < numKeys;i++){
+    //Load stored event data, spread across as many keys as needed
+    for(i = 0; bytesLoaded < expectedSize; i++){
       int key = PERSIST_KEY_EVENT_DATA_BEGIN+i;
-      if(persist_exists(key)){
-        size_t keysize, bytesRead;
-        if(i == numKeys-1)keysize = lastKeySize;
-        else keysize = PERSIST_DATA_MAX_LENGTH;
-        bytesRead=persist_read_data(key, index, keysize);
-        if(bytesRead != keysize){
-          #ifdef DEBUG_EVENTS
-            APP_LOG(APP_LOG_LEVEL_DEBUG,"Key %d:Expected to read %d bytes, read %d",i,(int)keysize,(int)bytesRead);
-          #endif
-          readSuccess = false;
-        }
-        #ifdef DEBUG_EVENTS
-          else APP_LOG(APP_LOG_LEVEL_DEBUG,"Key %d read successfully",i);
-        #endif
-        index += bytesRead;
-      }
-      else{//Event key not found in storage, stop loading
-        readSuccess = false;
-        break;
-      }
-    }
-    if(!readSuccess){
+      if(!persist_exists(key))break;//Event key not found in storage, stop loading
+      size_t keysize = expectedSize - bytesLoaded;
+      if(keysize > PERSIST_DATA_MAX_LENGTH)keysize = PERSIST_DATA_MAX_LENGTH;
+      int bytesRead = persist_read_data(key, index, keysize);
+      if(bytesRead <= 0)break;
       #ifdef DEBUG_EVENTS
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"Failed to find expected key %d, leaving blank event structure",i);
+        APP_LOG(APP_LOG_LEVEL_DEBUG,"Key %d: read %d bytes",i,bytesRead);
       #endif
+      index += bytesRead;
+      bytesLoaded += bytesRead;
+      //The header holds the saved size, only read that much
+      if(i == 0 && loaded.version == EVENT_DATA_VERSION && loaded.poolSize <= TITLE_POOL_SIZE){
+        expectedSize = event_data_size(&loaded);
+      }
     }
-    #ifdef DEBUG_EVENTS
-      for(i = 0; i <NUM_EVENTS;i++){
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"Restored event %d, titled %s",i,events[i].title);
+    bool readSuccess = bytesLoaded == expectedSize && loaded.version == EVENT_DATA_VERSION;
+    for(i = 0; readSuccess && i < NUM_EVENTS; i++){
+      if(loaded.events[i].title >= loaded.poolSize) readSuccess = false;
+    }
+    if(readSuccess){
+      memcpy(&eventData, &loaded, expectedSize);
+      //A checksum mismatch means saving was interrupted, so the data can't be trusted
+      readSuccess = event_data_checksum() == loaded.checksum;
+      if(!readSuccess){
+        for(i = 0; i < NUM_EVENTS; i++)clear_event(i);
+        compact_title_pool();
       }
+    }
+    if(readSuccess) savedChecksum = loaded.checksum;
+    else eventsDirty = true;//saved data is missing or invalid, replace all of it
+    #ifdef DEBUG_EVENTS
+    if(!readSuccess)APP_LOG(APP_LOG_LEVEL_DEBUG,"Failed to load saved events, leaving blank event structure");
+    for(i = 0; i <NUM_EVENTS;i++){
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"Restored event %d, titled %s",i,
+              eventData.titlePool + events[i].title);
+    }
     #endif
   if(persist_exists(PERSIST_KEY_FUTURE_EVENT_FORMAT))
     futureEventFormat = persist_read_int(PERSIST_KEY_FUTURE_EVENT_FORMAT);
+  if(persist_exists(PERSIST_KEY_REMINDER_TIMES))
+    persist_read_data(PERSIST_KEY_REMINDER_TIMES, reminderTimes, sizeof(reminderTimes));
+  if(persist_exists(PERSIST_KEY_BUSY_SLOTS))
+    persist_read_data(PERSIST_KEY_BUSY_SLOTS, &busyDay, sizeof(busyDay));
   events_initialized = 1;  
+  wakeup_service_subscribe(reminder_handler);
+  if(launch_reason() == APP_LAUNCH_WAKEUP){//launched to deliver a reminder
+    WakeupId wakeupID;
+    int32_t cookie;
+    if(wakeup_get_launch_event(&wakeupID, &cookie))reminder_handler(wakeupID, cookie);
+  }
+  else plan_reminders();
   }
 }
 
 //Shuts down event functionality
 void events_deinit(){
   if(events_initialized){
-    int numKeys, i;
-    size_t lastKeySize;
-    struct eventStruct * index;
-    //Save event data struct
-    numKeys =  sizeof(events)/PERSIST_DATA_MAX_LENGTH;
-    lastKeySize =  sizeof(events) % PERSIST_DATA_MAX_LENGTH;
-    if(lastKeySize > 0)numKeys++;
-    else lastKeySize = PERSIST_DATA_MAX_LENGTH;
-    #ifdef DEBUG_EVENTS
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"persist_save_events:Saving event data as %d keys",numKeys+1);
-    #endif
-    index = events;
-    for(i = 0;i < numKeys;i++){
-      size_t keysize;
-      if(i == numKeys-1)keysize = lastKeySize;
-      else keysize = PERSIST_DATA_MAX_LENGTH;
-      size_t bytesWritten =persist_write_data(PERSIST_KEY_EVENT_DATA_BEGIN+i, index, keysize);
-      
-      #ifdef DEBUG_EVENTS 
-      if(bytesWritten != keysize){
-        APP_LOG(APP_LOG_LEVEL_ERROR,
-                       "persist_save_events:Key %d:Expected to write %d bytes, wrote %d",i,(int)keysize,(int)bytesWritten);
-      }
-      else APP_LOG(APP_LOG_LEVEL_DEBUG,"persist_save_events:Key %d written successfully",i);
-      #endif
-      index += bytesWritten;
-    }
+    save_events();
     persist_write_int(PERSIST_KEY_FUTURE_EVENT_FORMAT, futureEventFormat);
+    persist_write_data(PERSIST_KEY_BUSY_SLOTS, &busyDay, sizeof(busyDay));
     events_initialized = 0;
   }
 }
 
 //Stores an event
-void add_event(int numEvent,char *title,long start,long end,char* color){
+void add_event(int numEvent,uint32_t eventID,char *title,long start,long end,GColor color){
   if(!events_initialized)events_init();
-  if(numEvent >= NUM_EVENTS){
+  if(numEvent < 0 || numEvent >= NUM_EVENTS){
     #ifdef DEBUG_EVENTS 
     APP_LOG(APP_LOG_LEVEL_ERROR,"Event %s is out of bounds at index %d",title,numEvent);
     #endif
     return;
   }
+  struct eventStruct * event = &events[numEvent];
+  uint8_t newColor = color.argb;
+  if(event->id == eventID && event->start == start && event->end == end && event->color == newColor
+     && strncmp(eventData.titlePool + event->title, title, MAX_EVENT_LENGTH - 1) == 0){
+    return;//event is unchanged
+  }
   #ifdef DEBUG_EVENTS 
     APP_LOG(APP_LOG_LEVEL_DEBUG,"add_event:creating an event with title %s",title);
   #endif
-  strncpy(events[numEvent].title,title,MAX_EVENT_LENGTH);
-  strncpy(events[numEvent].color,color,7);
-  events[numEvent].start = start;
-  events[numEvent].end = end;
+  //An event ID is only stored once, remove it from any other slot
+  if(eventID != 0){
+    for(int i = 0; i < NUM_EVENTS; i++){
+      if(i != numEvent && events[i].id == eventID)clear_event(i);
+    }
+  }
+  bool replacesPending = is_pending(numEvent);
+  eventsDirty = true;
+  event->title = EMPTY_TITLE;//release the old title before interning the new one
+  event->title = intern_title(title);
+  event->id = eventID;
+  event->color = newColor;
+  event->start = start;
+  event->end = end;
+  eventSetHashValid = false;
+  //A replaced event that already ended stays on the busy slot record
+  events_changed(replacesPending ? -1 : numEvent);
+}
+
+//Removes a stored event
+void delete_event(uint32_t eventID){
+  if(!events_initialized)events_init();
+  if(eventID == 0)return;
+  for(int i = 0; i < NUM_EVENTS; i++){
+    if(events[i].id == eventID){
+      #ifdef DEBUG_EVENTS 
+        APP_LOG(APP_LOG_LEVEL_DEBUG,"delete_event:removing event %d from slot %d",(int)eventID,i);
+      #endif
+      clear_event(i);
+      events_changed(i);
+    }
+  }
+}
+
+//Removes the event stored in an event slot
+void delete_event_slot(int numEvent){
+  if(!events_initialized)events_init();
+  if(numEvent < 0 || numEvent >= NUM_EVENTS)return;
+  if(events[numEvent].title == EMPTY_TITLE && events[numEvent].start == 0)return;//already empty
+  clear_event(numEvent);
+  events_changed(numEvent);
+}
+
+//Starts a group of event changes
+void events_begin_update(){
+  updateDepth++;
+}
+
+//Finishes a group of event changes
+void events_end_update(){
+  if(updateDepth == 0)return;
+  updateDepth--;
+  if(updateDepth == 0 && updateChanged){
+    updateChanged = false;
+    events_changed(-1);
+  }
+}
+
+//Sets the function to call whenever stored events change
+void set_events_changed_handler(EventsChangedHandler handler){
+  changedHandler = handler;
+}
+
+//Gets a hash value identifying the stored event set
+uint32_t get_event_set_hash(){
+  if(!events_initialized)events_init();
+  if(!eventSetHashValid){
+    uint32_t hash = FNV_OFFSET_BASIS;
+    for(int i = 0; i < NUM_EVENTS; i++){
+      int32_t times[2] = {events[i].start, events[i].end};
+      char * title = eventData.titlePool + events[i].title;
+      hash = hash_bytes(hash, &events[i].id, sizeof(events[i].id));
+      hash = hash_bytes(hash, times, sizeof(times));
+      hash = hash_bytes(hash, &events[i].color, sizeof(events[i].color));
+      hash = hash_bytes(hash, title, strlen(title) + 1);
+    }
+    eventSetHash = hash;
+    eventSetHashValid = true;
+  }
+  return eventSetHash;
 }
 
 //Gets one of the stored event titles
 char *get_event_title(int numEvent,char *buffer,int bufSize){
   if(!events_initialized)events_init();
   if(numEvent >= NUM_EVENTS)return NULL;//Check if event is within bounds
-  if(strcmp(events[numEvent].title,"")==0)return NULL;//Check if event exists
-  if(bufSize<=(int)strlen(events[numEvent].title))return NULL;
-  strncpy(buffer,events[numEvent].title,bufSize);
+  char * title = eventData.titlePool + events[numEvent].title;
+  if(strcmp(title,"")==0)return NULL;//Check if event exists
+  if(bufSize<=(int)strlen(title))return NULL;
+  strncpy(buffer,title,bufSize);
   return buffer;
 }
 
@@ -150,7 +293,7 @@ char *get_event_title(int numEvent,char *buffer,int bufSize){
 int get_percent_complete(int numEvent){
   if(!events_initialized)events_init();
   if(numEvent >= NUM_EVENTS)return -1;//Check if event is within bounds
-  if(strcmp(events[numEvent].title,"")==0)return -1;//Check if event exists
+  if(events[numEvent].title == EMPTY_TITLE)return -1;//Check if event exists
   if(events[numEvent].start == 0)return -1;//Check if event has a start time
   time_t now = time(NULL);
   if(events[numEvent].start <= (int)now){//Get percent completed if event has started
@@ -168,9 +311,9 @@ int get_percent_complete(int numEvent){
 char *get_event_time_string(int numEvent,char *buffer,int bufSize){
   if(!events_initialized)events_init();
   if(numEvent >= NUM_EVENTS)return NULL;//Check if event is within bounds
-  if(strcmp(events[numEvent].title,"")==0)return NULL;//Check if event exists
+  if(events[numEvent].title == EMPTY_TITLE)return NULL;//Check if event exists
   if(events[numEvent].start == 0)return NULL;//Check if event has a start time
-  if(strcmp(events[numEvent].title,"") == 0)return NULL;//Check if event has a title
+  if(events[numEvent].title == EMPTY_TITLE)return NULL;//Check if event has a title
   int percent = get_percent_complete(numEvent);
   
   if(percent != -1){//return percent complete if event has started
@@ -178,7 +321,8 @@ char *get_event_time_string(int numEvent,char *buffer,int bufSize){
   }else{//Get time until event if event hasn't started
     time_t now = time(NULL);
     if(events[numEvent].end < now){//Event is over, request new data and return null
-      request_update(UPDATE_TYPE_EVENT);
+      //Only ask again if events haven't been updated since the event ended
+      if(get_update_time(UPDATE_TYPE_EVENT) < events[numEvent].end)request_update(UPDATE_TYPE_EVENT);
       return NULL;
     }
     
@@ -246,24 +390,38 @@ char *get_event_time_string(int numEvent,char *buffer,int bufSize){
       struct tm *tick_time = localtime((time_t *)&(events[numEvent].start));
       static char s_buffer[16];
       strftime(s_buffer, sizeof(s_buffer), clock_is_24h_style() ? "%H:%M %d %e" : "%I:%M %d %e", tick_time);
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"get_event_time_string:Event %s starts at %s, %s from now",events[numEvent].title,s_buffer,buffer);
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"get_event_time_string:Event %s starts at %s, %s from now",eventData.titlePool + events[numEvent].title,s_buffer,buffer);
       tick_time = localtime((time_t *)&(events[numEvent].end));
       strftime(s_buffer, sizeof(s_buffer), clock_is_24h_style() ? "%H:%M %d %e" : "%I:%M %d %e", tick_time);
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"get_event_time_string:Event %s ends at %s",events[numEvent].title,s_buffer);
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"get_event_time_string:Event %s ends at %s",eventData.titlePool + events[numEvent].title,s_buffer);
     #endif
   }
   return buffer;
 }
 
-//Gets an event's display color string
-void get_event_color(int numEvent,char * buffer){
+//Gets the busy time slots for the current day
+const uint8_t * get_busy_slots(){
+  if(!events_initialized)events_init();
+  time_t now = time(NULL);
+  if(now < busyDay.dayStart || now >= busyDay.dayStart + SECONDS_PER_DAY){//start a new day
+    busyDay.dayStart = time_start_of_today();
+    memset(busyDay.slots, 0, sizeof(busyDay.slots));
+    for(int i = 0; i < NUM_EVENTS; i++)mark_busy_slots(i);
+  }
+  return busyDay.slots;
+}
+
+//Gets an event's display color
+GColor get_event_color(int numEvent){
+  GColor color = GColorClear;
   if(!events_initialized)events_init();
-  if(numEvent >= NUM_EVENTS)return;//Check if event is within bounds
-  if(strcmp(events[numEvent].title,"")==0)return;//Check if event exists
+  if(numEvent >= NUM_EVENTS)return color;//Check if event is within bounds
+  if(events[numEvent].title == EMPTY_TITLE)return color;//Check if event exists
   #ifdef DEBUG_EVENTS 
-    APP_LOG(APP_LOG_LEVEL_DEBUG,"get_event_color:Copying event number %d color:%s ",numEvent,events[numEvent].color);
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"get_event_color:Copying event number %d color:%d ",numEvent,events[numEvent].color);
   #endif
-  strcpy(buffer,events[numEvent].color);
+  color.argb = events[numEvent].color;
+  return color;
 }
 
 //Sets the format for upcoming event time strings
@@ -271,10 +429,283 @@ void setFutureEventTimeFormat(FutureEventFormat format){
   futureEventFormat = format;
 }
 
+//----------STATIC FUNCTIONS----------
 
+/**
+*Gets the number of bytes of event data that need to be saved
+*@param data the event data
+*@return the size of the data header and event records, plus
+*the used part of the title pool
+*/
+static size_t event_data_size(struct eventData * data){
+  return offsetof(struct eventData, titlePool) + data->poolSize;
+}
+
+/**
+*Finds a title within a title pool
+*@param pool the title pool to search
+*@param poolSize number of bytes used in the pool
+*@param title the title to find
+*@param length number of title characters to compare
+*@return the title's offset in the pool, or -1 if not found
+*/
+static int find_title(char * pool, int poolSize, char * title, size_t length){
+  int offset = 0;
+  while(offset < poolSize){
+    size_t pooledLength = strlen(pool + offset);
+    if(pooledLength == length && strncmp(pool + offset, title, length) == 0)return offset;
+    offset += pooledLength + 1;
+  }
+  return -1;
+}
 
+/**
+*Gets a title's offset in the title pool, adding it if necessary
+*@param title the event title, truncated to MAX_EVENT_LENGTH - 1 characters
+*@return the title's pool offset
+*@pre the event being given this title has released its old title
+*/
+static uint8_t intern_title(char * title){
+  size_t length = strlen(title);
+  if(length >= MAX_EVENT_LENGTH)length = MAX_EVENT_LENGTH - 1;
+  int offset = find_title(eventData.titlePool, eventData.poolSize, title, length);
+  if(offset >= 0)return offset;
+  //Once unused titles are removed, every other event's title still fits
+  if(eventData.poolSize + length + 1 > TITLE_POOL_SIZE)compact_title_pool();
+  offset = eventData.poolSize;
+  memcpy(eventData.titlePool + offset, title, length);
+  eventData.titlePool[offset + length] = '\0';
+  eventData.poolSize += length + 1;
+  eventsDirty = true;
+  return offset;
+}
+
+/**
+*Removes all titles no longer used by an event from the title pool
+*@post every event title is stored once, and the pool holds nothing else
+*/
+static void compact_title_pool(){
+  char compacted[TITLE_POOL_SIZE];
+  int compactedSize = 1;
+  compacted[EMPTY_TITLE] = '\0';
+  for(int i = 0; i < NUM_EVENTS; i++){
+    if(events[i].title == EMPTY_TITLE)continue;
+    char * title = eventData.titlePool + events[i].title;
+    size_t length = strlen(title);
+    int offset = find_title(compacted, compactedSize, title, length);
+    if(offset < 0){
+      offset = compactedSize;
+      memcpy(compacted + offset, title, length + 1);
+      compactedSize += length + 1;
+    }
+    events[i].title = offset;
+  }
+  memcpy(eventData.titlePool, compacted, compactedSize);
+  eventData.poolSize = compactedSize;
+  eventsDirty = true;//title offsets may have changed
+  #ifdef DEBUG_EVENTS
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"compact_title_pool:Title pool reduced to %d bytes",compactedSize);
+  #endif
+}
+
+/**
+*Saves event data after SAVE_DELAY, unless a save is already scheduled
+*Changes made before the timer runs out are saved together
+*/
+static void schedule_save(){
+  if(saveTimer == NULL && eventsDirty){
+    saveTimer = app_timer_register(SAVE_DELAY, save_timer_callback, NULL);
+  }
+}
 
+/**
+*Saves changed event data when the save timer runs out
+*@param data unused callback data
+*/
+static void save_timer_callback(void * data){
+  saveTimer = NULL;
+  save_events();
+}
 
+/**
+*Saves changed event data to persistent storage
+*Nothing is written if the data matches the last save. Event data fits in
+*a single key at the current NUM_EVENTS, so each save is one atomic write.
+*If it ever spans several keys, the first key holds the checksum and is
+*written last, so that an interrupted save is detected on load.
+*/
+static void save_events(){
+  if(saveTimer != NULL){
+    app_timer_cancel(saveTimer);
+    saveTimer = NULL;
+  }
+  if(!eventsDirty)return;
+  compact_title_pool();//don't save unused titles
+  eventData.checksum = event_data_checksum();
+  if(eventData.checksum == savedChecksum){
+    #ifdef DEBUG_EVENTS
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"save_events:Event data unchanged, skipping save");
+    #endif
+    eventsDirty = false;
+    return;
+  }
+  size_t dataSize = event_data_size(&eventData);
+  int numKeys = (dataSize + PERSIST_DATA_MAX_LENGTH - 1) / PERSIST_DATA_MAX_LENGTH;
+  for(int i = numKeys - 1; i >= 0; i--){
+    size_t keysize = dataSize - i * PERSIST_DATA_MAX_LENGTH;
+    if(keysize > PERSIST_DATA_MAX_LENGTH)keysize = PERSIST_DATA_MAX_LENGTH;
+    int bytesWritten = persist_write_data(PERSIST_KEY_EVENT_DATA_BEGIN + i,
+                                         ((uint8_t *) &eventData) + i * PERSIST_DATA_MAX_LENGTH, keysize);
+    if(bytesWritten != (int)keysize){
+      APP_LOG(APP_LOG_LEVEL_ERROR,"save_events:Key %d:Expected to write %d bytes, wrote %d",
+              i,(int)keysize,bytesWritten);
+      return;//leave data dirty so the next save tries again
+    }
+    #ifdef DEBUG_EVENTS
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"save_events:Key %d written successfully",i);
+    #endif
+  }
+  savedChecksum = eventData.checksum;
+  eventsDirty = false;
+}
 
+/**
+*Calculates the checksum of all saved event data
+*@return the FNV-1a hash of everything after the checksum field
+*/
+static uint32_t event_data_checksum(){
+  size_t start = offsetof(struct eventData, version);
+  return hash_bytes(FNV_OFFSET_BASIS, ((uint8_t *) &eventData) + start,
+                    event_data_size(&eventData) - start);
+}
 
+/**
+*Removes an event from its event slot
+*@param numEvent the event slot to clear
+*/
+static void clear_event(int numEvent){
+  bool wasPending = is_pending(numEvent);
+  eventsDirty = true;
+  events[numEvent].id = 0;
+  events[numEvent].title = EMPTY_TITLE;
+  events[numEvent].color = GColorBlackARGB8;
+  events[numEvent].start = 0;
+  events[numEvent].end = 0;
+  eventSetHashValid = false;
+  if(wasPending && updateDepth == 0)rebuild_busy_slots();
+}
 
+/**
+*Checks if an event slot holds an event that hasn't ended
+*@param numEvent the event slot
+*@return true iff the slot holds an event ending in the future
+*/
+static bool is_pending(int numEvent){
+  return events[numEvent].title != EMPTY_TITLE && events[numEvent].end > time(NULL);
+}
+
+/**
+*Marks the busy slots covered by an event
+*@param numEvent the event slot
+*@post every slot of the current day overlapping the event is set
+*/
+static void mark_busy_slots(int numEvent){
+  if(events[numEvent].title == EMPTY_TITLE || events[numEvent].start == 0)return;
+  long start = events[numEvent].start - busyDay.dayStart;
+  long end = events[numEvent].end - busyDay.dayStart;
+  if(start < 0)start = 0;
+  if(end > SECONDS_PER_DAY)end = SECONDS_PER_DAY;
+  if(end <= start)return;//event isn't on the current day
+  int lastSlot = (end - 1) / BUSY_SLOT_LENGTH;
+  for(int slot = start / BUSY_SLOT_LENGTH; slot <= lastSlot; slot++){
+    busyDay.slots[slot / 8] |= 1 << (slot % 8);
+  }
+}
+
+/**
+*Recalculates busy slots from the current time onward
+*@post slots before the current one are unchanged, later slots
+*are only set if covered by a stored event
+*/
+static void rebuild_busy_slots(){
+  long elapsed = time(NULL) - busyDay.dayStart;
+  if(elapsed < 0 || elapsed >= SECONDS_PER_DAY)return;//get_busy_slots will rebuild the new day
+  for(int slot = elapsed / BUSY_SLOT_LENGTH; slot < NUM_BUSY_SLOTS; slot++){
+    busyDay.slots[slot / 8] &= ~(1 << (slot % 8));
+  }
+  for(int i = 0; i < NUM_EVENTS; i++)mark_busy_slots(i);
+}
+
+/**
+*Updates everything depending on stored events after they change.
+*Within an events_begin_update group, this waits until the group ends.
+*@param numEvent the changed event slot, or -1 to recalculate all busy slots
+*/
+static void events_changed(int numEvent){
+  if(updateDepth > 0){
+    updateChanged = true;
+    return;
+  }
+  if(numEvent < 0)rebuild_busy_slots();
+  else mark_busy_slots(numEvent);
+  plan_reminders();
+  schedule_save();
+  if(changedHandler != NULL)changedHandler();
+}
+
+/**
+*Schedules reminder wakeups for upcoming events
+*@post a wakeup is scheduled REMINDER_LEAD_TIME before each upcoming event,
+*up to the NUM_REMINDERS earliest events. Wakeups are only re-scheduled if
+*the planned reminder times changed.
+*/
+static void plan_reminders(){
+  time_t now = time(NULL);
+  time_t planned[NUM_REMINDERS] = {0};
+  int numPlanned = 0;
+  //Find the earliest reminder times, sorted by insertion
+  for(int i = 0; i < NUM_EVENTS; i++){
+    time_t reminder = events[i].start - REMINDER_LEAD_TIME;
+    if(events[i].title == EMPTY_TITLE || events[i].start == 0 || reminder <= now)continue;
+    int index = numPlanned < NUM_REMINDERS ? numPlanned++ : NUM_REMINDERS;
+    while(index > 0 && planned[index-1] > reminder){
+      if(index < NUM_REMINDERS)planned[index] = planned[index-1];
+      index--;
+    }
+    if(index < NUM_REMINDERS)planned[index] = reminder;
+  }
+  //Wakeups must be at least WAKEUP_SPACING apart, delay reminders that are too close
+  for(int i = 1; i < numPlanned; i++){
+    if(planned[i] < planned[i-1] + WAKEUP_SPACING)planned[i] = planned[i-1] + WAKEUP_SPACING;
+  }
+  if(memcmp(planned, reminderTimes, sizeof(planned)) == 0)return;//schedule is unchanged
+  wakeup_cancel_all();
+  for(int i = 0; i < numPlanned; i++){
+    WakeupId wakeupID = wakeup_schedule(planned[i], i, true);
+    if(wakeupID < 0){
+      #ifdef DEBUG_EVENTS
+        APP_LOG(APP_LOG_LEVEL_ERROR,"plan_reminders:Scheduling reminder failed with code %d",(int)wakeupID);
+      #endif
+      planned[i] = 0;
+    }
+  }
+  memcpy(reminderTimes, planned, sizeof(planned));
+  persist_write_data(PERSIST_KEY_REMINDER_TIMES, reminderTimes, sizeof(reminderTimes));
+  #ifdef DEBUG_EVENTS
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"plan_reminders:Scheduled %d reminders",numPlanned);
+  #endif
+}
+
+/**
+*Vibrates to remind the user of an upcoming event
+*Called automatically when a reminder wakeup occurs
+*@param wakeupID the wakeup's ID
+*@param cookie the reminder number
+*/
+static void reminder_handler(WakeupId wakeupID, int32_t cookie){
+  #ifdef DEBUG_EVENTS
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"reminder_handler:Reminder %d triggered",(int)cookie);
+  #endif
+  vibes_double_pulse();
+  plan_reminders();
+}
@@ -9,6 +9,11 @@
 
 #define MAX_EVENT_LENGTH 24 //Maximum number of characters allowed in an event title
 #define NUM_EVENTS 2  //Number of events stored
+#define NUM_BUSY_SLOTS 96 //Number of 15 minute busy time slots in a day
+#define BUSY_SLOT_BYTES (NUM_BUSY_SLOTS / 8) //Size of the busy slot bitset
+
+//Function called whenever stored events change
+typedef void (* EventsChangedHandler)();
 
 /**
 *initializes event functionality 
@@ -21,14 +26,54 @@ void events_init();
 void events_deinit();
 
 /**
-*Stores an event
+*Stores an event, replacing any other stored event with the same ID
 *@param numEvent the event slot to set
+*@param eventID the companion app's ID for the event, or 0 if unknown
 *@param title the event title
 *@param start the event start time
 *@param end the event end time
-*@param color the event color string
+*@param color the event color
+*/
+void add_event(int numEvent,uint32_t eventID,char *title,long start,long end,GColor color);
+
+/**
+*Removes a stored event
+*@param eventID the companion app's ID for the event
+*/
+void delete_event(uint32_t eventID);
+
+/**
+*Removes the event stored in an event slot
+*@param numEvent the event slot to clear
+*/
+void delete_event_slot(int numEvent);
+
+/**
+*Starts a group of event changes. Reminders, busy slots, saving and
+*the EventsChangedHandler are only updated once the matching
+*events_end_update call is made.
+*/
+void events_begin_update();
+
+/**
+*Finishes a group of event changes started with events_begin_update
+*/
+void events_end_update();
+
+/**
+*Sets the function to call whenever stored events change
+*@param handler the change handling function
 */
-void add_event(int numEvent,char *title,long start,long end,char* color);
+void set_events_changed_handler(EventsChangedHandler handler);
+
+/**
+*Gets a hash value identifying the stored event set
+*The hash is 32 bit FNV-1a over each event slot in order, covering
+*the event ID, start and end times (little-endian int32 values), the
+*GColor8 color byte, and the null-terminated title.
+*@return the event set hash
+*/
+uint32_t get_event_set_hash();
 
 /**
 *Gets one of the stored event titles
@@ -60,9 +105,18 @@ char *get_event_time_string(int numEvent,char *buffer,int bufSize);
 /**
 *Gets an event's display color
 *@param numEvent the event to access
-*@param buffer color string is copied into this, must be at least 7 bytes
+*@return the event color, or GColorClear if the event doesn't exist
+*/
+GColor get_event_color(int numEvent);
+
+/**
+*Gets the busy time slots for the current day
+*Slot n covers 15 minutes starting n*15 minutes after midnight, and is
+*stored in bit n%8 of byte n/8. Slots before the current time stay marked
+*for events that have since been replaced.
+*@return a BUSY_SLOT_BYTES bitset, set for each slot covered by an event
 */
-void get_event_color(int numEvent,char * buffer);
+const uint8_t * get_busy_slots();
 
 typedef enum{
   TIME_REMAINING_ONLY,
@@ -0,0 +1,91 @@
+#include <pebble.h>
+#include "forecast.h"
+#include "display_handler.h"
+#include "storage_keys.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+//#define DEBUG_FORECAST //uncomment to enable forecast debug logging
+#define FORECAST_DATA_VERSION 1 //Saved forecast format, change whenever forecastData changes
+
+//----------FORECAST DATA STRUCTURE----------
+//Stored forecast, saved to persistent storage as a single block
+struct forecastData{
+  uint8_t version;//saved data format, equal to FORECAST_DATA_VERSION
+  uint8_t count;//number of slots in use
+  uint16_t slotLength;//seconds covered by each slot
+  uint32_t start;//time the first slot begins
+  ForecastSlot slots[MAX_FORECAST_SLOTS];//forecast weather, in time order
+};
+
+//----------LOCAL VARIABLES----------
+static struct forecastData forecast = {.version = FORECAST_DATA_VERSION};
+static int shownSlot = -1;//Index of the displayed forecast slot, or -1 if none is shown
+
+//----------STATIC FUNCTION DECLARATIONS----------
+static void save_forecast();
+  //Saves the forecast to persistent storage
+
+//----------PUBLIC FUNCTIONS----------
+//Loads the saved forecast
+void forecast_init(){
+  if(persist_exists(PERSIST_KEY_FORECAST)){
+    struct forecastData saved;
+    persist_read_data(PERSIST_KEY_FORECAST, &saved, sizeof(saved));
+    if(saved.version == FORECAST_DATA_VERSION && saved.count <= MAX_FORECAST_SLOTS
+       && saved.slotLength > 0)forecast = saved;
+  }
+  shownSlot = -1;
+}
+
+//Replaces the stored forecast
+void set_forecast(time_t start, uint16_t slotLength, const ForecastSlot slots[], uint8_t count){
+  if(count > MAX_FORECAST_SLOTS)count = MAX_FORECAST_SLOTS;
+  if(slotLength == 0)count = 0;
+  #ifdef DEBUG_FORECAST
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"set_forecast:%d slots of %d seconds from %d",
+          count,slotLength,(int)start);
+  #endif
+  forecast.start = start;
+  forecast.slotLength = slotLength;
+  forecast.count = count;
+  memcpy(forecast.slots, slots, count * sizeof(ForecastSlot));
+  save_forecast();
+  shownSlot = -1;
+  update_forecast(time(NULL));
+}
+
+//Removes the stored forecast
+void clear_forecast(){
+  if(forecast.count == 0)return;
+  forecast.count = 0;
+  save_forecast();
+  shownSlot = -1;
+}
+
+//Displays the forecast slot covering a given time
+void update_forecast(time_t now){
+  if(forecast.count == 0 || now < (time_t) forecast.start)return;
+  int slot = (now - forecast.start) / forecast.slotLength;
+  //Once the forecast runs out, the last slot stays shown until new weather arrives
+  if(slot >= forecast.count || slot == shownSlot)return;
+  shownSlot = slot;
+  #ifdef DEBUG_FORECAST
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"update_forecast:Showing slot %d",slot);
+  #endif
+  update_weather(forecast.slots[slot].temperature, forecast.slots[slot].condition);
+}
+
+//Gets the time the stored forecast runs out
+time_t get_forecast_end(){
+  if(forecast.count == 0)return 0;
+  return forecast.start + forecast.count * forecast.slotLength;
+}
+
+//----------STATIC FUNCTIONS----------
+
+/**
+*Saves the forecast to persistent storage
+*/
+static void save_forecast(){
+  persist_write_data(PERSIST_KEY_FORECAST, &forecast, sizeof(forecast));
+}
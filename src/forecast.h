@@ -0,0 +1,49 @@
+/**
+*@File forecast.h
+*Stores the weather forecast sent by the companion app, and
+*keeps the displayed weather on the forecast slot covering
+*the current time
+*/
+
+#pragma once
+#include <pebble.h>
+
+#define MAX_FORECAST_SLOTS 24 //Number of forecast slots stored
+
+//Forecast weather for one slot of time
+typedef struct{
+  int16_t temperature;//temperature in degrees
+  uint16_t condition;//OpenWeatherAPI condition code
+} ForecastSlot;
+
+/**
+*Loads the saved forecast
+*/
+void forecast_init();
+
+/**
+*Replaces the stored forecast, and displays the slot covering the current time
+*@param start the time the first slot begins
+*@param slotLength seconds covered by each slot
+*@param slots forecast weather, in time order
+*@param count number of slots. Slots past MAX_FORECAST_SLOTS are ignored.
+*/
+void set_forecast(time_t start, uint16_t slotLength, const ForecastSlot slots[], uint8_t count);
+
+/**
+*Removes the stored forecast, so displayed weather is only
+*changed by new weather updates
+*/
+void clear_forecast();
+
+/**
+*Displays the forecast slot covering a given time, if it isn't already shown
+*@param now the current time
+*/
+void update_forecast(time_t now);
+
+/**
+*Gets the time the stored forecast runs out
+*@return the end of the last forecast slot, or 0 if there is no forecast
+*/
+time_t get_forecast_end();
@@ -1,5 +1,7 @@
 #include <pebble.h>
 #include "events.h"
+#include "forecast.h"
+#include "phone_battery.h"
 #include "message_handler.h"
 #include "util.h"
 #include "display_handler.h"
@@ -10,6 +12,20 @@
 //#define DEBUG_MAIN  //uncomment to enable main program debug logging
 
 //----------STATIC FUNCTIONS----------
+/**
+*Updates displayed events and the day overview from stored events
+*/
+static void update_event_displays() {
+  for(int i = 0; i < NUM_EVENTS; i++){//update display events
+    char eventTitle[MAX_EVENT_LENGTH];
+    char eventTime[MAX_EVENT_LENGTH];
+    get_event_title(i, eventTitle, sizeof(eventTitle));
+    get_event_time_string(i, eventTime, sizeof(eventTime));
+    update_event_display(i, eventTitle, eventTime, get_percent_complete(i), get_event_color(i));
+  }
+  update_day_overview(get_busy_slots());
+}
+
 /**
 *Updates the currently displayed time
 */
@@ -23,51 +39,12 @@ static void update_time() {
   APP_LOG(APP_LOG_LEVEL_DEBUG,"update_time: setting display time");
   #endif
   set_time(now);//update time display
-  for(int i = 0; i < NUM_EVENTS; i++){//update display events
-    char eventTitle[MAX_EVENT_LENGTH];
-    char eventTime[MAX_EVENT_LENGTH];
-    char eventColor[7];
-    get_event_title(i, eventTitle, sizeof(eventTitle));
-    get_event_time_string(i, eventTime, sizeof(eventTime));
-    get_event_color(i, eventColor);
-    update_event_display(i, eventTitle, eventTime, get_percent_complete(i), eventColor);
-  }
+  update_forecast(now);
+  update_event_displays();
   //if phone is connected, possibly get updates
-  if(connection_service_peek_pebble_app_connection()){
-    for(int i = 0; i < NUM_UPDATE_TYPES; i++){
-      //load update time & update frequency
-      time_t lastUpdate = get_update_time(i);
-      int updateFreq = get_update_frequency(i);
-      #ifdef DEBUG_MAIN 
-        char updateType[10];
-        switch((UpdateType) i){
-          case UPDATE_TYPE_EVENT:
-            strcpy(updateType,"Events");
-            break;
-          case UPDATE_TYPE_BATTERY:
-            strcpy(updateType,"Battery");
-            break;
-          case UPDATE_TYPE_WEATHER:
-            strcpy(updateType,"Weather");
-            break;
-          case UPDATE_TYPE_INFOTEXT:
-            strcpy(updateType,"InfoText");
-            break;
-          default:
-            strcpy(updateType,"Invalid Type!");
-        }
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"update_time:%s= Last Update:%d Next: %d minutes, updateFreq:%d min",
-              updateType,(int)lastUpdate,((int)lastUpdate+updateFreq-(int)now)/60,updateFreq/60);
-      #endif
-      if(now > (lastUpdate + updateFreq)){
-        #ifdef DEBUG_MAIN
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"update_time: sending request");
-        #endif
-        request_update(i);
-      }
-    }    
-  }
-  else update_text("X",TEXT_PHONE_BATTERY);//phone is disconnected, set phone battery to X
+  bool connected = connection_service_peek_pebble_app_connection();
+  update_phone_battery(now, connected);
+  if(connected)request_due_updates();
   
   //Finally,update pebble battery info
   char pbl_battery_buf[6];
@@ -92,7 +69,10 @@ void handle_init(void) {
     setSavedUptime(persist_read_int(PERSIST_KEY_UPTIME));
   //initialize modules
   display_init();
+  forecast_init();
+  phone_battery_init();
   events_init();
+  set_events_changed_handler(update_event_displays);//refresh as soon as events change
   message_handler_init();
   // Register with TickTimerService
   tick_timer_service_subscribe(MINUTE_UNIT, tick_handler);
@@ -110,6 +90,7 @@ void handle_init(void) {
 //unload program
 void handle_deinit(void) {
   events_deinit();
+  phone_battery_deinit();
   messaging_deinit();
   display_deinit();
   //Update runtime stats
@@ -1,106 +1,461 @@
 #include <pebble.h>
+#include <stddef.h>
 #include "message_handler.h"
 #include "display_handler.h"
 #include "display_elements.h"
 #include "messaging_core.h"
+#include "message_protocol.h"
 #include "events.h"
 #include "util.h"
 #include "storage_keys.h"
+#include "codec.h"
+#include "forecast.h"
+#include "phone_battery.h"
 
 //----------LOCAL VALUE DEFINITIONS----------
 //#define DEBUG_MESSAGING //Uncomment to enable messaging debug logging
 #define DEFAULT_UPDATE_FREQ 300 //default update frequency(seconds)
-//----------APPMESSAGE KEY DEFINITIONS----------
-enum{
+#define REQUEST_COLLECT_DELAY 50 //Milliseconds to collect update requests before sending them together
+#define RESPONSE_TIMEOUT 120 //Seconds to wait for a response before requesting the same update again
+//Updates due within a type's slack window are requested early, together with an
+//update that is already due, so the radio wakes once for all of them. Each window
+//is a percentage of the type's update interval, up to SCHEDULE_MAX_SLACK.
+#define SLACK_PERCENT_EVENT 10
+#define SLACK_PERCENT_BATTERY 25
+#define SLACK_PERCENT_INFOTEXT 25
+#define SLACK_PERCENT_WEATHER 25
+#define SLACK_PERCENT_PEBBLE_STATS 50
+#define SCHEDULE_MAX_SLACK 900 //Largest slack window(seconds)
+#define NEVER_DUE ((time_t) INT32_MAX) //Schedule due time of update types that aren't requested while resting
+#define FORECAST_REFRESH_MARGIN 3600 //Seconds before a forecast runs out to request a new one
+//Battery, infoText and weather intervals adapt to how often their responses change,
+//between bounds set by Android. Responses that keep changing are polled at the
+//shortest interval, and responses that never change at the longest.
+#define CHANGE_RATE_ONE 1024 //Change rate of a type whose every response changes
+#define CHANGE_RATE_WEIGHT 4 //Each response moves the change rate 1/CHANGE_RATE_WEIGHT of the way
+#define DEFAULT_MAX_FREQ_FACTOR 6 //Default longest interval, as a multiple of the update frequency
+//Update intervals are scaled by watch battery band, see intervalScales
+#define BATTERY_LOW_PERCENT 20 //Watch charge below this is in BATTERY_BAND_LOW
+#define BATTERY_MEDIUM_PERCENT 50 //Watch charge below this is in BATTERY_BAND_MEDIUM
+#define MIN_INTERVAL_SCALE 10 //Smallest interval scale percentage accepted from Android
+#define MAX_INTERVAL_SCALE 16383 //Largest interval scale percentage, the largest two byte varint
+//During quiet hours, or once the watch hasn't moved for INACTIVITY_WINDOW, only
+//events are requested, at most every RESTING_EVENT_FREQ
+#define INACTIVITY_WINDOW 3600 //Seconds without wrist movement before the watch is inactive
+#define MOVEMENT_SAMPLES 25 //Accelerometer samples per batch, 2.5 seconds at ACCEL_SAMPLING_10HZ
+#define MOVEMENT_THRESHOLD 150 //Change between samples(mG, summed over all axes) that counts as movement
+#define RESTING_EVENT_FREQ 3600 //Shortest event update interval while resting(seconds)
+#define MINUTES_PER_DAY 1440
+#define SUBSCRIBED_UPDATE_FREQ 21600 //Seconds between safety polls for update types Android pushes
+#define SUBSCRIBE_MESSAGE_TYPE 0xFF //Queued message type for subscriptions, outside the range of request masks
+#define METRICS_MESSAGE_TYPE 0xFE //Queued message type for messaging metrics
+#define SUBSCRIBE_PRIORITY UINT8_MAX //Subscriptions are sent before any update request
+#define MAX_UPDATE_PRIORITY (SUBSCRIBE_PRIORITY - 1) //Highest priority Android may give an update type
+//Changes smaller than these thresholds aren't pushed by Android. Event and
+//infoText thresholds are unused, as any change is pushed.
+#define THRESHOLD_BATTERY 5 //Phone battery percentage
+#define THRESHOLD_WEATHER 2 //Temperature degrees
+//Default message priorities for each update type, higher priorities are sent first
+#define DEFAULT_PRIORITY_EVENT 4
+#define DEFAULT_PRIORITY_BATTERY 3
+#define DEFAULT_PRIORITY_WEATHER 2
+#define DEFAULT_PRIORITY_INFOTEXT 1
+#define DEFAULT_PRIORITY_PEBBLE_STATS 0
+//----------UPDATE REQUEST FIELDS----------
+//Integer fields written with every update request, in message order
+typedef enum{
+  FIELD_MESSAGE_CODE,
+  FIELD_REQUEST_TYPES,
+  FIELD_EVENT_SET_HASH,
+  FIELD_SESSION_START,
+  FIELD_CODEC_VERSION,
+  FIELD_UPTIME,
+  FIELD_TOTAL_UPTIME,
+  FIELD_MODE_12_OR_24,
+  FIELD_PEBBLE_MODEL,
+  FIELD_PEBBLE_COLOR,
+  FIELD_MEMORY_USED,
+  FIELD_MEMORY_FREE,
+  FIELD_INBOX_SIZE,
+  NUM_REQUEST_FIELDS
+} RequestField;
+
+//Message keys for each RequestField
+static const uint32_t requestKeys[NUM_REQUEST_FIELDS] = {
   KEY_MESSAGE_CODE,
-    //int32: identifying the purpose of the message, bi-directional
-  KEY_BATTERY_UPDATE,
-    //cstring: containing the sender's battery life percentage, bi-directional
-  KEY_EVENT_TITLE,
-    //cstring: an event's title string, sent from Android
-  KEY_EVENT_START,
-    //int32: event start time, sent from Android
-  KEY_EVENT_END,
-    //int32: event end time, sent from Android
-  KEY_EVENT_COLOR,
-    //cstring: event color, sent from Android
-  KEY_EVENT_NUM,
-    //int32: event index number, sent from Android
-  KEY_INFOTEXT,
-    //cstring: configurable information string, sent from Android
+  KEY_REQUEST_TYPES,
+  KEY_EVENT_SET_HASH,
+  KEY_SESSION_START,
+  KEY_CODEC_VERSION,
   KEY_UPTIME,
-    //int32: current watchface uptime in seconds, sent from Pebble
   KEY_TOTAL_UPTIME,
-    //int32: total watchface uptime in seconds, sent from Pebble
+  KEY_MODE_12_OR_24,
   KEY_PEBBLE_MODEL,
-    //int32: pebble model as an enum WatchInfoModel, sent from Pebble
   KEY_PEBBLE_COLOR,
-    //int32: pebble color as an enum WatchInfoColor, sent from Pebble
-  KEY_MODE_12_OR_24,
-    //int32: whether the pebble is set to 12 or 24 hour mode(as 12 or 24), sent from Pebble
-  KEY_TEMPERATURE,
-    //int32: current temperature, sent from Android
-  KEY_WEATHER_COND,
-    //int32: an OpenWeatherAPI condition code, sent by Android
   KEY_MEMORY_USED,
-    //int32: amount of memory used by the watchapp, sent from Pebble
   KEY_MEMORY_FREE,
-    //int32: amount of memory available for watchapp, sent from Pebble
-  KEY_DATE_FORMAT,
-    //cstring: date format recognizable by strftime
-  KEY_FUTURE_EVENT_TIME_FORMAT,
-    //int32: index of the enum FutureEventFormat type selected, sent from Android
-  KEY_DISPLAY_THEME,
-    //int32: index of the enum Theme type selected, sent from Android
-  KEY_UPDATE_FREQS_BEGIN = 30,
-    //int32: First update frequency(seconds), sent from Android
-    //This begins a series of keys holding update frequencies for all update types
-    //Update types are defined in order in messaging.h
-  KEY_COLORS_BEGIN = 50
-    //cstring: Holds the first color string, sent by Android
-    //This is the first of a sequence of NUM_COLORS color keys
-    //NUM_COLORS is defined in display.h
+  KEY_INBOX_SIZE
 };
 
-//----------APPMESSAGE MESSAGE CODES----------
-//Valid message codes for messages sent from Pebble
+//When each RequestField is included in an update request
 typedef enum{
-  CODE_EVENT_REQUEST,
-    //Message requesting updated event info
-  CODE_BATTERY_REQUEST,
-    //Message requesting updated battery percentage
-  CODE_INFOTEXT_REQUEST,
-    //Message requesting updated infoText data
-  CODE_WEATHER_REQUEST,
-    //Message requesting updated weather data
-  CODE_PEBBLE_STATS_RESPONSE
-    //Message providing requested Pebble information
-} PebbleMessageCode;
-
-//Valid message codes for messages received from Android
+  SEND_ALWAYS,
+  SEND_WITH_EVENTS,
+    //Only sent when events are requested
+  SEND_ON_SESSION_START,
+    //Only sent in the first request of a session
+  SEND_IF_CHANGED
+    //Sent at session start, and whenever the value differs from the last delivered value
+} FieldSendMode;
+
+//Send modes for each RequestField
+static const uint8_t requestFieldModes[NUM_REQUEST_FIELDS] = {
+  SEND_ALWAYS,//FIELD_MESSAGE_CODE
+  SEND_ALWAYS,//FIELD_REQUEST_TYPES
+  SEND_WITH_EVENTS,//FIELD_EVENT_SET_HASH
+  SEND_ON_SESSION_START,//FIELD_SESSION_START
+  SEND_ON_SESSION_START,//FIELD_CODEC_VERSION
+  SEND_ON_SESSION_START,//FIELD_UPTIME
+  SEND_ON_SESSION_START,//FIELD_TOTAL_UPTIME
+  SEND_IF_CHANGED,//FIELD_MODE_12_OR_24
+  SEND_ON_SESSION_START,//FIELD_PEBBLE_MODEL
+  SEND_ON_SESSION_START,//FIELD_PEBBLE_COLOR
+  SEND_IF_CHANGED,//FIELD_MEMORY_USED
+  SEND_IF_CHANGED,//FIELD_MEMORY_FREE
+  SEND_IF_CHANGED//FIELD_INBOX_SIZE
+};
+
+//----------INBOX MESSAGE STAGING----------
+//Received values, staged by read_message before the message is processed.
+//Sequences of keys take one field for each key.
 typedef enum{
-  CODE_EVENT_RESPONSE,
-    //Message providing updated event info
-  CODE_BATTERY_RESPONSE,
-    //Message providing updated battery percentage
-  CODE_INFOTEXT_RESPONSE,
-    //Message providing updated infoText data
-  CODE_WEATHER_RESPONSE,
-    //Message providing updated weather data
-  CODE_COLOR_UPDATE,
-    //Message providing updated color data
-  CODE_PEBBLE_STATS_REQUEST,
-    //Message requesting assorted Pebble information
-} AndroidMessageCode;
+  IN_MESSAGE_CODE,
+  IN_BATTERY,
+  IN_EVENT_TITLE,
+  IN_EVENT_START,
+  IN_EVENT_END,
+  IN_EVENT_COLOR,
+  IN_EVENT_NUM,
+  IN_EVENT_ID,
+  IN_INFOTEXT,
+  IN_TEMPERATURE,
+  IN_WEATHER_COND,
+  IN_DATE_FORMAT,
+  IN_FUTURE_EVENT_TIME_FORMAT,
+  IN_DISPLAY_THEME,
+  IN_PACKED_EVENT,
+  IN_PACKED_WEATHER,
+  IN_PACKED_COLORS,
+  IN_PACKED_SETTINGS,
+  IN_PACKED_BATTERY,
+  IN_PACKED_EVENT_LIST,
+  IN_SUBSCRIBED_TYPES,
+  IN_PACKED_FORECAST,
+  IN_INTERVAL_SCALES,
+  IN_QUIET_HOURS_START,
+  IN_QUIET_HOURS_END,
+  IN_UPDATE_BOUNDS,
+  IN_UPDATE_FREQS_BEGIN,
+  IN_UPDATE_PRIORITIES_BEGIN = IN_UPDATE_FREQS_BEGIN + NUM_UPDATE_TYPES,
+  IN_COLORS_BEGIN = IN_UPDATE_PRIORITIES_BEGIN + NUM_UPDATE_TYPES,
+  NUM_INBOX_FIELDS = IN_COLORS_BEGIN + NUM_COLORS
+} InboxField;
+_Static_assert(NUM_INBOX_FIELDS <= 64, "InboxMessage.received has a bit for each InboxField");
+
+//Holds the values of one received message. Strings point into the
+//received dictionary, and are only valid until processing finishes.
+typedef struct{
+  uint64_t received;//bit n is set if InboxField n was received
+  int32_t messageCode;
+  char * battery;
+  char * eventTitle;
+  int32_t eventStart;
+  int32_t eventEnd;
+  char * eventColor;
+  int32_t eventNum;
+  int32_t eventID;
+  char * infoText;
+  int32_t temperature;
+  int32_t weatherCond;
+  char * dateFormat;
+  int32_t futureEventTimeFormat;
+  int32_t theme;
+  Tuple * packedEvent;
+  Tuple * packedWeather;
+  Tuple * packedColors;
+  Tuple * packedSettings;
+  Tuple * packedBattery;
+  Tuple * packedEventList;
+  int32_t subscribedTypes;
+  Tuple * packedForecast;
+  Tuple * packedIntervalScales;
+  int32_t quietHoursStart;
+  int32_t quietHoursEnd;
+  Tuple * packedUpdateBounds;
+  int32_t updateFreqs[NUM_UPDATE_TYPES];
+  int32_t updatePriorities[NUM_UPDATE_TYPES];
+  char * colors[NUM_COLORS];
+} InboxMessage;
+
+//Checks if an InboxMessage holds a given InboxField
+#define RECEIVED(message, field) (((message)->received >> (field)) & 1)
+
+//Value types that received tuples are staged as
+typedef enum{
+  STAGE_INT32,
+  STAGE_CSTRING,
+  STAGE_BYTE_ARRAY
+    //Staged as the Tuple, to be decoded while processing the message
+} StageType;
+
+//Maps a range of message keys to the InboxMessage values they're staged in
+typedef struct{
+  uint32_t firstKey;//first message key in the range
+  uint8_t numKeys;//number of sequential keys in the range
+  uint8_t field;//InboxField of the first key
+  uint8_t type;//StageType of each key's value
+  uint16_t offset;//offset of the first key's value in InboxMessage
+} InboxRoute;
+
+#define INBOX_ROUTE(key, count, field, type, member) \
+  {key, count, field, type, offsetof(InboxMessage, member)}
+
+//Every message key read from Android
+static const InboxRoute inboxRoutes[] = {
+  INBOX_ROUTE(KEY_MESSAGE_CODE, 1, IN_MESSAGE_CODE, STAGE_INT32, messageCode),
+  INBOX_ROUTE(KEY_BATTERY_UPDATE, 1, IN_BATTERY, STAGE_CSTRING, battery),
+  INBOX_ROUTE(KEY_EVENT_TITLE, 1, IN_EVENT_TITLE, STAGE_CSTRING, eventTitle),
+  INBOX_ROUTE(KEY_EVENT_START, 1, IN_EVENT_START, STAGE_INT32, eventStart),
+  INBOX_ROUTE(KEY_EVENT_END, 1, IN_EVENT_END, STAGE_INT32, eventEnd),
+  INBOX_ROUTE(KEY_EVENT_COLOR, 1, IN_EVENT_COLOR, STAGE_CSTRING, eventColor),
+  INBOX_ROUTE(KEY_EVENT_NUM, 1, IN_EVENT_NUM, STAGE_INT32, eventNum),
+  INBOX_ROUTE(KEY_EVENT_ID, 1, IN_EVENT_ID, STAGE_INT32, eventID),
+  INBOX_ROUTE(KEY_INFOTEXT, 1, IN_INFOTEXT, STAGE_CSTRING, infoText),
+  INBOX_ROUTE(KEY_TEMPERATURE, 1, IN_TEMPERATURE, STAGE_INT32, temperature),
+  INBOX_ROUTE(KEY_WEATHER_COND, 1, IN_WEATHER_COND, STAGE_INT32, weatherCond),
+  INBOX_ROUTE(KEY_DATE_FORMAT, 1, IN_DATE_FORMAT, STAGE_CSTRING, dateFormat),
+  INBOX_ROUTE(KEY_FUTURE_EVENT_TIME_FORMAT, 1, IN_FUTURE_EVENT_TIME_FORMAT, STAGE_INT32,
+              futureEventTimeFormat),
+  INBOX_ROUTE(KEY_DISPLAY_THEME, 1, IN_DISPLAY_THEME, STAGE_INT32, theme),
+  INBOX_ROUTE(KEY_PACKED_EVENT, 1, IN_PACKED_EVENT, STAGE_BYTE_ARRAY, packedEvent),
+  INBOX_ROUTE(KEY_PACKED_WEATHER, 1, IN_PACKED_WEATHER, STAGE_BYTE_ARRAY, packedWeather),
+  INBOX_ROUTE(KEY_PACKED_COLORS, 1, IN_PACKED_COLORS, STAGE_BYTE_ARRAY, packedColors),
+  INBOX_ROUTE(KEY_PACKED_SETTINGS, 1, IN_PACKED_SETTINGS, STAGE_BYTE_ARRAY, packedSettings),
+  INBOX_ROUTE(KEY_PACKED_BATTERY, 1, IN_PACKED_BATTERY, STAGE_BYTE_ARRAY, packedBattery),
+  INBOX_ROUTE(KEY_PACKED_EVENT_LIST, 1, IN_PACKED_EVENT_LIST, STAGE_BYTE_ARRAY,
+              packedEventList),
+  INBOX_ROUTE(KEY_SUBSCRIBED_TYPES, 1, IN_SUBSCRIBED_TYPES, STAGE_INT32, subscribedTypes),
+  INBOX_ROUTE(KEY_PACKED_FORECAST, 1, IN_PACKED_FORECAST, STAGE_BYTE_ARRAY, packedForecast),
+  INBOX_ROUTE(KEY_INTERVAL_SCALES, 1, IN_INTERVAL_SCALES, STAGE_BYTE_ARRAY,
+              packedIntervalScales),
+  INBOX_ROUTE(KEY_QUIET_HOURS_START, 1, IN_QUIET_HOURS_START, STAGE_INT32, quietHoursStart),
+  INBOX_ROUTE(KEY_QUIET_HOURS_END, 1, IN_QUIET_HOURS_END, STAGE_INT32, quietHoursEnd),
+  INBOX_ROUTE(KEY_UPDATE_BOUNDS, 1, IN_UPDATE_BOUNDS, STAGE_BYTE_ARRAY, packedUpdateBounds),
+  INBOX_ROUTE(KEY_UPDATE_FREQS_BEGIN, NUM_UPDATE_TYPES, IN_UPDATE_FREQS_BEGIN, STAGE_INT32,
+              updateFreqs),
+  INBOX_ROUTE(KEY_UPDATE_PRIORITIES_BEGIN, NUM_UPDATE_TYPES, IN_UPDATE_PRIORITIES_BEGIN,
+              STAGE_INT32, updatePriorities),
+  INBOX_ROUTE(KEY_COLORS_BEGIN, NUM_COLORS, IN_COLORS_BEGIN, STAGE_CSTRING, colors)
+};
+#define NUM_INBOX_ROUTES (sizeof(inboxRoutes) / sizeof(inboxRoutes[0]))
+_Static_assert(NUM_INBOX_ROUTES < UINT8_MAX, "Route indices must fit in keyRoutes");
+#define NO_ROUTE 0xFF //keyRoutes value of keys Android doesn't send
+
+//----------APPMESSAGE BUFFER SIZES----------
+//Buffers are sized for the largest message each side can send, so no
+//memory is wasted on unused buffer space.
+#define TUPLE_SIZE(valueSize) (sizeof(Tuple) + (valueSize)) //Dictionary bytes used by one value
+#define INT_TUPLE TUPLE_SIZE(sizeof(int32_t))
+#define MAX_STRING_SIZE CODEC_MAX_STRING //Largest string Android sends, including the null terminator
+#define COLOR_STRING_SIZE 7 //Hex color string size, including the null terminator
+#define BATTERY_STRING_SIZE 6 //Battery string size, including the null terminator
+//Update requests, with every field included. Subscriptions and metrics are smaller.
+#define OUTBOX_SIZE (1 + NUM_REQUEST_FIELDS * INT_TUPLE + TUPLE_SIZE(BATTERY_STRING_SIZE))
+_Static_assert(1 + INT_TUPLE + TUPLE_SIZE(METRICS_SIZE) <= OUTBOX_SIZE,
+               "Messaging metrics must fit in the outbox");
+//Interval scale payloads, with every scale at most MAX_INTERVAL_SCALE
+#define INTERVAL_SCALES_SIZE (1 + 2 * NUM_BATTERY_BANDS * NUM_UPDATE_TYPES)
+//Update bounds payloads, with every bound under 2^21 seconds
+#define UPDATE_BOUNDS_SIZE (1 + 6 * NUM_UPDATE_TYPES)
+//Optional settings, sent alone in CODE_SETTINGS_UPDATE messages or during bulk transfers
+#define SETTINGS_VALUES_SIZE (2 * NUM_UPDATE_TYPES * INT_TUPLE + TUPLE_SIZE(MAX_STRING_SIZE) \
+  + INT_TUPLE + TUPLE_SIZE(INTERVAL_SCALES_SIZE) + 2 * INT_TUPLE + TUPLE_SIZE(UPDATE_BOUNDS_SIZE))
+//Settings, legacy event and color messages are the largest message bodies Android
+//sends. Packed payloads, event list parts holding one event, and forecasts of up to
+//MAX_FORECAST_SLOTS compact slots are smaller.
+#define EVENT_VALUES_SIZE (TUPLE_SIZE(MAX_STRING_SIZE) + 4 * INT_TUPLE \
+  + TUPLE_SIZE(COLOR_STRING_SIZE))
+#define COLOR_VALUES_SIZE (INT_TUPLE + NUM_COLORS * TUPLE_SIZE(COLOR_STRING_SIZE))
+#define RESPONSE_VALUES_SIZE \
+  (EVENT_VALUES_SIZE > COLOR_VALUES_SIZE ? EVENT_VALUES_SIZE : COLOR_VALUES_SIZE)
+#define INBOX_SIZE (1 + INT_TUPLE + (SETTINGS_VALUES_SIZE > RESPONSE_VALUES_SIZE ? \
+  SETTINGS_VALUES_SIZE : RESPONSE_VALUES_SIZE))
+
+//----------UPDATE SCHEDULE----------
+//Watch battery states with their own update interval scales
+typedef enum{
+  BATTERY_BAND_CHARGING,
+    //Plugged in, at any charge level
+  BATTERY_BAND_HIGH,
+    //At least BATTERY_MEDIUM_PERCENT charge
+  BATTERY_BAND_MEDIUM,
+    //At least BATTERY_LOW_PERCENT charge
+  BATTERY_BAND_LOW,
+    //Less than BATTERY_LOW_PERCENT charge
+  NUM_BATTERY_BANDS
+} BatteryBand;
+
+//When one update type should next be requested
+typedef struct{
+  time_t due;//time the update type should next be requested
+  uint8_t type;//UpdateType
+} ScheduleEntry;
 
 //----------LOCAL VARIABLES----------
 
 time_t lastUpdate[NUM_UPDATE_TYPES] = {0};
   //Last data update times
-static int updateFreq[NUM_UPDATE_TYPES] = {DEFAULT_UPDATE_FREQ};
+static int updateFreq[NUM_UPDATE_TYPES] = {
+  DEFAULT_UPDATE_FREQ, DEFAULT_UPDATE_FREQ, DEFAULT_UPDATE_FREQ, DEFAULT_UPDATE_FREQ, DEFAULT_UPDATE_FREQ
+};
   //Update frequencies sent from android
+static uint8_t updatePriority[NUM_UPDATE_TYPES] = {
+  DEFAULT_PRIORITY_EVENT,
+  DEFAULT_PRIORITY_BATTERY,
+  DEFAULT_PRIORITY_INFOTEXT,
+  DEFAULT_PRIORITY_WEATHER,
+  DEFAULT_PRIORITY_PEBBLE_STATS
+};
+  //Message priorities for each update type, may be changed from android
+
+static const int32_t subscribeThresholds[NUM_UPDATE_TYPES] = {
+  0,//UPDATE_TYPE_EVENT
+  THRESHOLD_BATTERY,//UPDATE_TYPE_BATTERY
+  0,//UPDATE_TYPE_INFOTEXT
+  THRESHOLD_WEATHER,//UPDATE_TYPE_WEATHER
+  0//UPDATE_TYPE_PEBBLE_STATS
+};
+  //Change thresholds sent with subscriptions
+static uint32_t responseFingerprints[NUM_UPDATE_TYPES] = {0};
+  //Hashes of the last applied response message for each update type, or 0 if unknown
+static uint16_t changeRates[NUM_UPDATE_TYPES] = {
+  CHANGE_RATE_ONE, CHANGE_RATE_ONE, CHANGE_RATE_ONE, CHANGE_RATE_ONE, CHANGE_RATE_ONE
+};
+  //Weighted average fraction of responses that changed for each update type,
+  //out of CHANGE_RATE_ONE. Types start out polled at their shortest interval.
+static CodecUpdateBounds updateBounds[NUM_UPDATE_TYPES] = {{0}};
+  //Adaptive update interval bounds sent from android, or 0 for defaults
+static uint8_t subscribedTypes = 0;
+  //Bitmask of update types Android has agreed to push this session
+static const uint8_t slackPercent[NUM_UPDATE_TYPES] = {
+  SLACK_PERCENT_EVENT,
+  SLACK_PERCENT_BATTERY,
+  SLACK_PERCENT_INFOTEXT,
+  SLACK_PERCENT_WEATHER,
+  SLACK_PERCENT_PEBBLE_STATS
+};
+  //Slack windows for each update type, as a percentage of its update interval
+static uint16_t intervalScales[NUM_BATTERY_BANDS][NUM_UPDATE_TYPES] = {
+  {50, 50, 50, 50, 100},//BATTERY_BAND_CHARGING
+  {100, 100, 100, 100, 100},//BATTERY_BAND_HIGH
+  {100, 150, 150, 150, 100},//BATTERY_BAND_MEDIUM
+  {150, 400, 400, 400, 100}//BATTERY_BAND_LOW
+};
+  //Update intervals for each battery band, as percentages of each update type's
+  //update frequency, may be changed from android
+static uint8_t batteryBand = BATTERY_BAND_HIGH;
+  //Current watch BatteryBand
+static int quietHoursStart = 0;
+  //Minutes after midnight that quiet hours begin
+static int quietHoursEnd = 0;
+  //Minutes after midnight that quiet hours end
+static time_t lastMovement = 0;
+  //Last time the accelerometer saw wrist movement
+static bool resting = false;
+  //True during quiet hours or inactivity, when only events are requested
+static ScheduleEntry schedule[NUM_UPDATE_TYPES];
+  //Min-heap of update due times, with the earliest due time first
+static bool scheduleChanged = true;
+  //True if due times may have changed since the schedule was built
+static uint8_t pendingRequests = 0;
+  //Bitmask of update types to request in the next update request
+static uint8_t awaitingResponse = 0;
+  //Bitmask of requested update types that haven't been received yet
+static time_t requestTimes[NUM_UPDATE_TYPES] = {0};
+  //Last time each update type was requested
+static uint32_t requestTimesMs[NUM_UPDATE_TYPES] = {0};
+  //messaging_time_ms timestamp of each update type's last request, for latency metrics
+static AppTimer * requestTimer = NULL;
+  //Timer for sending collected update requests
+static AppTimer * bulkTimer = NULL;
+  //Timer for ending a bulk transfer if its response never arrives
+static int32_t requestTemplate[NUM_REQUEST_FIELDS];
+  //Update request field values. Constant fields are set once in
+  //message_handler_init, variable fields are patched in before each write.
+static int32_t ackedValues[NUM_REQUEST_FIELDS];
+  //Field values in the last request Android acknowledged
+static int32_t sentValues[NUM_REQUEST_FIELDS];
+  //Field values in the request currently being sent
+static char ackedBattery[6] = "";
+  //Battery string in the last request Android acknowledged
+static char sentBattery[6] = "";
+  //Battery string in the request currently being sent
+static bool sessionStarted = false;
+  //True once Android has acknowledged a session start request
+static bool sentSessionStart = false;
+  //True if the request currently being sent starts a session
+static uint8_t keyRoutes[NUM_MESSAGE_KEYS];
+  //Index of each message key's InboxRoute, or NO_ROUTE. Built in message_handler_init.
+static struct{
+  uint8_t numParts;//number of parts in the list being received
+  uint32_t receivedParts;//bit n is set once part n has been received
+  uint32_t listedSlots;//bit n is set if event slot n is in the list
+  CodecEvent events[NUM_EVENTS];//listed events, by slot
+  time_t starts[NUM_EVENTS];//listed events' start times, as parts may have different bases
+} eventList = {0};
+  //Event list parts received so far, applied together once complete
 
 static void process_message(DictionaryIterator *iterator);
+static void read_message(DictionaryIterator *iterator, InboxMessage * message);
+static void stage_tuple(InboxMessage * message, Tuple * tuple);
+static bool read_int(Tuple * tuple, int32_t * value);
+static bool read_packed_event(Tuple * tuple);
+static bool read_packed_weather(Tuple * tuple);
+static bool read_packed_forecast(Tuple * tuple);
+static bool read_packed_colors(Tuple * tuple);
+static bool read_packed_settings(Tuple * tuple);
+static bool read_packed_battery(Tuple * tuple);
+static bool read_packed_event_list(Tuple * tuple);
+static bool read_interval_scales(Tuple * tuple);
+static bool read_update_bounds(Tuple * tuple);
+static void send_requests(void * data);
+static void subscribe();
+static void write_message(DictionaryIterator * outbox, const uint8_t * data, uint16_t size);
+static void message_sent(const uint8_t * data, uint16_t size);
+static void write_request(DictionaryIterator * outbox, uint8_t requestTypes);
+static void write_subscription(DictionaryIterator * outbox, uint8_t types);
+static void write_metrics(DictionaryIterator * outbox);
+static void request_sent();
+static void app_connection_handler(bool connected);
+static void resync_updates();
+static void catch_up_updates();
+static void response_received(UpdateType updateType);
+static bool payload_changed(uint32_t * appliedFingerprint, uint32_t fingerprint);
+static bool response_changed(UpdateType updateType, uint32_t fingerprint);
+static int adaptive_interval(UpdateType updateType);
+static int effective_interval(UpdateType updateType);
+static time_t next_due_time(UpdateType updateType);
+static void build_schedule();
+static void heapify_schedule();
+static void schedule_sift_down(int index, int size);
+static void end_bulk_sync();
+static void finish_bulk_sync();
+static void bulk_sync_timeout(void * data);
+static BatteryBand get_battery_band(BatteryChargeState charge);
+static void battery_state_handler(BatteryChargeState charge);
+static bool in_quiet_hours(time_t now);
+static bool is_resting(time_t now);
+static void accel_data_handler(AccelData * data, uint32_t num_samples);
 static int appContacted = 0;//1 if the companion app has been reached
 //----------PUBLIC FUNCTIONS----------
 //Initializes AppMessage functionality
@@ -115,88 +470,131 @@ void message_handler_init(){
       lastUpdate[i] = (time_t) persist_read_int(PERSIST_KEY_LAST_UPDATE_TIMES_BEGIN + i);   
     if(persist_exists(PERSIST_KEY_UPDATE_FREQS_BEGIN+i))
         updateFreq[i] = persist_read_int(PERSIST_KEY_UPDATE_FREQS_BEGIN + i);
+    if(persist_exists(PERSIST_KEY_UPDATE_PRIORITIES_BEGIN + i))
+        updatePriority[i] = persist_read_int(PERSIST_KEY_UPDATE_PRIORITIES_BEGIN + i);
   }
+  if(persist_exists(PERSIST_KEY_UPDATE_BOUNDS))
+    persist_read_data(PERSIST_KEY_UPDATE_BOUNDS, updateBounds, sizeof(updateBounds));
+  if(persist_exists(PERSIST_KEY_CHANGE_RATES))
+    persist_read_data(PERSIST_KEY_CHANGE_RATES, changeRates, sizeof(changeRates));
+  if(persist_exists(PERSIST_KEY_INTERVAL_SCALES))
+    persist_read_data(PERSIST_KEY_INTERVAL_SCALES, intervalScales, sizeof(intervalScales));
+  batteryBand = get_battery_band(battery_state_service_peek());
+  battery_state_service_subscribe(battery_state_handler);
+  if(persist_exists(PERSIST_KEY_QUIET_HOURS_START) && persist_exists(PERSIST_KEY_QUIET_HOURS_END)){
+    quietHoursStart = persist_read_int(PERSIST_KEY_QUIET_HOURS_START);
+    quietHoursEnd = persist_read_int(PERSIST_KEY_QUIET_HOURS_END);
+  }
+  memset(keyRoutes, NO_ROUTE, sizeof(keyRoutes));
+  for(unsigned int i = 0; i < NUM_INBOX_ROUTES; i++){
+    const InboxRoute * route = &inboxRoutes[i];
+    for(int key = route->firstKey; key < route->firstKey + route->numKeys; key++)keyRoutes[key] = i;
+  }
+  lastMovement = time(NULL);
+  resting = is_resting(lastMovement);
+  accel_data_service_subscribe(MOVEMENT_SAMPLES, accel_data_handler);
+  accel_service_set_sampling_rate(ACCEL_SAMPLING_10HZ);
+  //Prepare the update request template
+  requestTemplate[FIELD_MESSAGE_CODE] = CODE_UPDATE_REQUEST;
+  requestTemplate[FIELD_SESSION_START] = 1;
+  requestTemplate[FIELD_CODEC_VERSION] = CODEC_VERSION;
+  requestTemplate[FIELD_PEBBLE_MODEL] = (int32_t) watch_info_get_model();
+  requestTemplate[FIELD_PEBBLE_COLOR] = (int32_t) watch_info_get_color();
+  set_buffer_sizes(INBOX_SIZE, OUTBOX_SIZE);
   open_messaging();
   register_inbox_handler(process_message);
+  register_outbox_writer(write_message);
+  register_outbox_sent_handler(message_sent);
+  connection_service_subscribe((ConnectionHandlers){
+    .pebble_app_connection_handler = app_connection_handler
+  });
+  subscribe();
 }
 
 //Shuts down AppMessage functionality
 void messaging_deinit(){
-  
+  if(requestTimer != NULL){
+    app_timer_cancel(requestTimer);
+    requestTimer = NULL;
+  }
+  end_bulk_sync();
+  connection_service_unsubscribe();
+  battery_state_service_unsubscribe();
+  accel_data_service_unsubscribe();
     //save persistent values
     for(int i=0;i< NUM_UPDATE_TYPES; i++){
       persist_write_int(PERSIST_KEY_LAST_UPDATE_TIMES_BEGIN+i,(int)lastUpdate[i]);
       persist_write_int(PERSIST_KEY_UPDATE_FREQS_BEGIN+i,updateFreq[i]);
+      persist_write_int(PERSIST_KEY_UPDATE_PRIORITIES_BEGIN+i,updatePriority[i]);
     }
     persist_write_int(PERSIST_KEY_COMPANION_APP_CONTACTED,appContacted);
+    persist_write_data(PERSIST_KEY_CHANGE_RATES, changeRates, sizeof(changeRates));
     close_messaging();
 }
 
 //Requests updated info from the companion app
 void request_update(UpdateType updateType){
   if(appContacted == 0)return;//Don't request updates until connected
-  
-  uint8_t buf[DICT_SIZE] = {0};//default buffer values to 0 to avoid 
-    //junk data overwriting legitimate keys
-  DictionaryIterator iter;
-  //request all events:
-  dict_write_begin(&iter,buf,DICT_SIZE);
-  switch(updateType){
-    case UPDATE_TYPE_EVENT:
-      dict_write_int32(&iter, KEY_MESSAGE_CODE, CODE_EVENT_REQUEST);
-      #ifdef DEBUG_MESSAGING
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:Requesting event update");
-      #endif
-      break;
-    case UPDATE_TYPE_BATTERY:
-      dict_write_int32(&iter, KEY_MESSAGE_CODE, CODE_BATTERY_REQUEST);
-      #ifdef DEBUG_MESSAGING
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:Requesting battery update");
-      #endif
-      break;
-    case UPDATE_TYPE_INFOTEXT:
-      dict_write_int32(&iter, KEY_MESSAGE_CODE, CODE_INFOTEXT_REQUEST);
-      #ifdef DEBUG_MESSAGING
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:Requesting infoText update");
-      #endif
-      break;
-    case UPDATE_TYPE_WEATHER:
-      dict_write_int32(&iter, KEY_MESSAGE_CODE, CODE_WEATHER_REQUEST);
-      #ifdef DEBUG_MESSAGING
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:Requesting weather update");
-      #endif
-      break;
-    case UPDATE_TYPE_PEBBLE_STATS:
-      dict_write_int32(&iter, KEY_MESSAGE_CODE, CODE_PEBBLE_STATS_RESPONSE);
+  if(updateType < 0 || updateType >= NUM_UPDATE_TYPES){
+    APP_LOG(APP_LOG_LEVEL_ERROR,"request_update:invalid request type");
+    return;
+  }
+  //Skip types already requested and still awaiting a response
+  if((awaitingResponse & (1 << updateType)) &&
+     time(NULL) < requestTimes[updateType] + RESPONSE_TIMEOUT){
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:Update type %d already requested",updateType);
+    #endif
+    return;
+  }
+  pendingRequests |= 1 << updateType;
+  //Requests made before the timer runs out are sent in the same message
+  if(requestTimer == NULL)
+    requestTimer = app_timer_register(REQUEST_COLLECT_DELAY, send_requests, NULL);
+}
+
+//Requests every update that is due, along with updates that are nearly due
+void request_due_updates(){
+  if(appContacted == 0)return;
+  if(scheduleChanged)build_schedule();
+  time_t now = time(NULL);
+  if(is_resting(now) != resting){
+    resting = !resting;
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"request_due_updates:Resting:%d",resting);
+    #endif
+    build_schedule();
+  }
+  if(schedule[0].due > now + SCHEDULE_MAX_SLACK)return;//Nothing is within a slack window yet
+  //Pop every update within its slack window, earliest first
+  bool requested = false;
+  int size = NUM_UPDATE_TYPES;
+  while(size > 0 && schedule[0].due <= now + SCHEDULE_MAX_SLACK){
+    UpdateType type = schedule[0].type;
+    int slack = effective_interval(type) * slackPercent[type] / 100;
+    if(slack > SCHEDULE_MAX_SLACK)slack = SCHEDULE_MAX_SLACK;
+    if(schedule[0].due <= now + slack){
       #ifdef DEBUG_MESSAGING
-      APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:sending stats update");
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"request_due_updates:Type %d due in %d seconds",
+              type,(int)(schedule[0].due - now));
       #endif
-      break;
-    default:
-      APP_LOG(APP_LOG_LEVEL_ERROR,"request_update:invalid request type");
-      return;
+      request_update(type);
+      requested = true;
+    }
+    //Move the popped entry past the end of the heap
+    size--;
+    ScheduleEntry popped = schedule[0];
+    schedule[0] = schedule[size];
+    schedule[size] = popped;
+    schedule_sift_down(0, size);
   }
-  //Append extra pebble data to dictionary
-  char batteryBuf [6];
-  getPebbleBattery(batteryBuf);
-  dict_write_cstring(&iter, KEY_BATTERY_UPDATE, batteryBuf);
-  dict_write_int32(&iter, KEY_UPTIME, getUptime());
-  dict_write_int32(&iter,KEY_TOTAL_UPTIME,getTotalUptime());
-  dict_write_int32(&iter,KEY_MODE_12_OR_24,clock_is_24h_style() ? 24 : 12);
-  dict_write_int32(&iter, KEY_PEBBLE_MODEL, (int) watch_info_get_model());
-  dict_write_int32(&iter, KEY_PEBBLE_COLOR, (int) watch_info_get_color());
-  dict_write_int32(&iter, KEY_MEMORY_USED, (int)heap_bytes_used());
-  dict_write_int32(&iter, KEY_MEMORY_FREE, (int)heap_bytes_free());
-  dict_write_end(&iter);
-  #ifdef DEBUG_MESSAGING
-  APP_LOG(APP_LOG_LEVEL_DEBUG,"request_update:Attempting to send request");
-  #endif
-  add_message(buf);
+  if(requested)scheduleChanged = true;//Rebuild next time, with new request times
+  else if(size < NUM_UPDATE_TYPES)heapify_schedule();//Due times are unchanged, restore the popped entries
 }
 
 //Gets the update frequency for a given request
 int get_update_frequency(UpdateType updateType){
-  return updateFreq[updateType];
+  return effective_interval(updateType);
 }
 
 //Gets the last time a given update was received
@@ -206,126 +604,927 @@ time_t get_update_time(UpdateType updateType){
 
 //----------STATIC FUNCTIONS----------
 
+/**
+*Sends all pending update requests in a single message
+*@param data unused callback data
+*/
+static void send_requests(void * data){
+  requestTimer = NULL;
+  if(pendingRequests == 0)return;
+  #ifdef DEBUG_MESSAGING
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"send_requests:Requesting update types %x",pendingRequests);
+  #endif
+  //Pebble stats are sent, not requested, so there's no response to wait for
+  time_t now = time(NULL);
+  uint32_t nowMs = messaging_time_ms();
+  uint8_t requested = pendingRequests & ~(1 << UPDATE_TYPE_PEBBLE_STATS);
+  uint8_t priority = 0;//Requests are sent with the priority of their most important type
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    if(requested & (1 << i)){
+      requestTimes[i] = now;
+      requestTimesMs[i] = nowMs;
+    }
+    if((pendingRequests & (1 << i)) && updatePriority[i] > priority)priority = updatePriority[i];
+  }
+  awaitingResponse |= requested;
+  scheduleChanged = true;
+  //The first event request of a session gets a full event list, so open
+  //a larger inbox for it
+  if((requested & (1 << UPDATE_TYPE_EVENT)) && !sessionStarted){
+    begin_bulk_transfer();
+    if(bulkTimer != NULL)app_timer_cancel(bulkTimer);
+    bulkTimer = app_timer_register(RESPONSE_TIMEOUT * 1000, bulk_sync_timeout, NULL);
+  }
+  //Only the requested types are queued, the message is built when it's sent
+  //Drop requests that can't be sent before a new request would be allowed
+  TRACE("Q %d", pendingRequests);
+  uint8_t descriptor[] = {CODE_UPDATE_REQUEST, pendingRequests};
+  add_message(descriptor, sizeof(descriptor), pendingRequests, priority, RESPONSE_TIMEOUT);
+  //Messaging metrics go out separately, so requests don't need a larger outbox
+  if(pendingRequests & (1 << UPDATE_TYPE_PEBBLE_STATS)){
+    uint8_t metricsDescriptor[] = {CODE_PEBBLE_STATS_RESPONSE, 0};
+    add_message(metricsDescriptor, sizeof(metricsDescriptor), METRICS_MESSAGE_TYPE,
+                updatePriority[UPDATE_TYPE_PEBBLE_STATS], RESPONSE_TIMEOUT);
+  }
+  pendingRequests = 0;
+}
+
+/**
+*Asks Android to push changes to every update type it provides
+*/
+static void subscribe(){
+  if(appContacted == 0 || !connection_service_peek_pebble_app_connection())return;
+  uint8_t descriptor[] = {CODE_SUBSCRIBE, ((1 << NUM_UPDATE_TYPES) - 1) & ~(1 << UPDATE_TYPE_PEBBLE_STATS)};
+  add_message(descriptor, sizeof(descriptor), SUBSCRIBE_MESSAGE_TYPE, SUBSCRIBE_PRIORITY, RESPONSE_TIMEOUT);
+}
+
+/**
+*Writes a queued message into the outbox
+*@param outbox the outbox dictionary iterator
+*@param data the queued descriptor, holding a PebbleMessageCode and
+*an update type bitmask
+*@param size the descriptor size in bytes
+*/
+static void write_message(DictionaryIterator * outbox, const uint8_t * data, uint16_t size){
+  if(size < 2)return;
+  switch((PebbleMessageCode) data[0]){
+    case CODE_UPDATE_REQUEST:
+      write_request(outbox, data[1]);
+      break;
+    case CODE_SUBSCRIBE:
+      write_subscription(outbox, data[1]);
+      break;
+    case CODE_PEBBLE_STATS_RESPONSE:
+      write_metrics(outbox);
+      break;
+    default:
+      APP_LOG(APP_LOG_LEVEL_ERROR,"write_message:Invalid queued message code");
+  }
+}
+
+/**
+*Handles acknowledgement of a queued message
+*@param data the acknowledged descriptor
+*@param size the descriptor size in bytes
+*/
+static void message_sent(const uint8_t * data, uint16_t size){
+  if(size < 2 || data[0] != CODE_UPDATE_REQUEST)return;
+  request_sent();
+  //Pebble stats are sent, not requested, so they're up to date once Android has them
+  if(data[1] & (1 << UPDATE_TYPE_PEBBLE_STATS)){
+    lastUpdate[UPDATE_TYPE_PEBBLE_STATS] = time(NULL);
+    scheduleChanged = true;
+  }
+}
+
+/**
+*Writes an update request into the outbox
+*@param outbox the outbox dictionary iterator
+*@param requestTypes the requested update type bitmask
+*/
+static void write_request(DictionaryIterator * outbox, uint8_t requestTypes){
+  //Patch variable fields into the template
+  requestTemplate[FIELD_REQUEST_TYPES] = requestTypes;
+  requestTemplate[FIELD_EVENT_SET_HASH] = (int32_t) get_event_set_hash();
+  requestTemplate[FIELD_UPTIME] = getUptime();
+  requestTemplate[FIELD_TOTAL_UPTIME] = getTotalUptime();
+  requestTemplate[FIELD_MODE_12_OR_24] = clock_is_24h_style() ? 24 : 12;
+  requestTemplate[FIELD_MEMORY_USED] = (int32_t) heap_bytes_used();
+  requestTemplate[FIELD_MEMORY_FREE] = (int32_t) heap_bytes_free();
+  requestTemplate[FIELD_INBOX_SIZE] = (int32_t) get_inbox_size();
+  char batteryBuf [6];
+  getPebbleBattery(batteryBuf);
+  sentSessionStart = !sessionStarted;
+  for(int i = 0; i < NUM_REQUEST_FIELDS; i++){
+    bool send;
+    switch(requestFieldModes[i]){
+      case SEND_WITH_EVENTS:
+        send = requestTypes & (1 << UPDATE_TYPE_EVENT);
+        break;
+      case SEND_ON_SESSION_START:
+        send = sentSessionStart;
+        break;
+      case SEND_IF_CHANGED:
+        send = sentSessionStart || requestTemplate[i] != ackedValues[i];
+        break;
+      default:
+        send = true;
+    }
+    if(send)dict_write_int32(outbox, requestKeys[i], requestTemplate[i]);
+  }
+  if(sentSessionStart || strcmp(batteryBuf, ackedBattery) != 0)
+    dict_write_cstring(outbox, KEY_BATTERY_UPDATE, batteryBuf);
+  //Remember what was sent, to be compared against once it's acknowledged
+  memcpy(sentValues, requestTemplate, sizeof(sentValues));
+  strcpy(sentBattery, batteryBuf);
+}
+
+/**
+*Writes a subscription into the outbox
+*@param outbox the outbox dictionary iterator
+*@param types the bitmask of update types to subscribe to
+*/
+static void write_subscription(DictionaryIterator * outbox, uint8_t types){
+  dict_write_int32(outbox, KEY_MESSAGE_CODE, CODE_SUBSCRIBE);
+  dict_write_int32(outbox, KEY_SUBSCRIBED_TYPES, types);
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++)
+    dict_write_int32(outbox, KEY_THRESHOLDS_BEGIN + i, subscribeThresholds[i]);
+}
+
+/**
+*Writes current messaging metrics into the outbox
+*@param outbox the outbox dictionary iterator
+*/
+static void write_metrics(DictionaryIterator * outbox){
+  uint8_t buffer[METRICS_SIZE];
+  uint16_t size = write_messaging_metrics(buffer);
+  dict_write_int32(outbox, KEY_MESSAGE_CODE, CODE_PEBBLE_STATS_RESPONSE);
+  dict_write_data(outbox, KEY_METRICS, buffer, size);
+}
+
+/**
+*Records the values Android received when a request is acknowledged
+*/
+static void request_sent(){
+  memcpy(ackedValues, sentValues, sizeof(ackedValues));
+  strcpy(ackedBattery, sentBattery);
+  if(sentSessionStart){
+    sessionStarted = true;
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"request_sent:Session started");
+    #endif
+  }
+}
+
+/**
+*Starts a new session whenever the Android app reconnects
+*@param connected true if the Android app is now connected
+*/
+static void app_connection_handler(bool connected){
+  sessionStarted = false;
+  subscribedTypes = 0;//Android may not be running to push updates anymore
+  scheduleChanged = true;
+  //The display shows the phone as disconnected, so the next responses must be applied
+  memset(responseFingerprints, 0, sizeof(responseFingerprints));
+  end_bulk_sync();
+  if(connected){
+    resume_messaging();
+    subscribe();
+    resync_updates();
+  }
+}
+
+/**
+*Requests every out of date update type after reconnecting. The most important
+*stale type is requested on its own, so its response isn't held up by the others.
+*/
+static void resync_updates(){
+  if(appContacted == 0)return;
+  awaitingResponse = 0;//Requests made while disconnected were never sent
+  catch_up_updates();
+  request_update(UPDATE_TYPE_PEBBLE_STATS);
+}
+
+/**
+*Requests every out of date update type, or only events while resting. The most
+*important stale type is requested on its own, so its response isn't held up by
+*the others.
+*/
+static void catch_up_updates(){
+  if(appContacted == 0)return;
+  time_t now = time(NULL);
+  int mostImportant = -1;
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    if(i == UPDATE_TYPE_PEBBLE_STATS || (resting && i != UPDATE_TYPE_EVENT) ||
+       now <= lastUpdate[i] + effective_interval(i))continue;
+    if(mostImportant < 0 || updatePriority[i] > updatePriority[mostImportant])mostImportant = i;
+  }
+  if(mostImportant >= 0){
+    request_update(mostImportant);
+    if(requestTimer != NULL){
+      app_timer_cancel(requestTimer);
+      requestTimer = NULL;
+    }
+    send_requests(NULL);
+  }
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    if(i == mostImportant || i == UPDATE_TYPE_PEBBLE_STATS || (resting && i != UPDATE_TYPE_EVENT))
+      continue;
+    if(now > lastUpdate[i] + effective_interval(i))request_update(i);
+  }
+}
+
+/**
+*Marks a requested update type as received
+*@param updateType the update type received
+*/
+static void response_received(UpdateType updateType){
+  lastUpdate[updateType] = time(NULL);
+  //Pushed updates weren't requested, so only requested updates have a latency
+  if(awaitingResponse & (1 << updateType))
+    record_response_latency(updateType, messaging_time_ms() - requestTimesMs[updateType]);
+  awaitingResponse &= ~(1 << updateType);
+}
+
+/**
+*Checks if a response differs from the last one applied, and remembers it
+*@param appliedFingerprint the last applied response's hash, updated to fingerprint
+*@param fingerprint the new response's hash
+*@return false if the response is identical to the last one applied
+*/
+static bool payload_changed(uint32_t * appliedFingerprint, uint32_t fingerprint){
+  if(*appliedFingerprint == fingerprint){
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"payload_changed:Skipping unchanged response");
+    #endif
+    return false;
+  }
+  *appliedFingerprint = fingerprint;
+  return true;
+}
+
+/**
+*Checks if a battery, infoText or weather response differs from the last one
+*applied, and updates the type's change rate
+*@param updateType the response's update type
+*@param fingerprint the response message's hash
+*@return false if the response is identical to the last one applied
+*/
+static bool response_changed(UpdateType updateType, uint32_t fingerprint){
+  //Responses after a reconnect have nothing to compare against
+  bool known = responseFingerprints[updateType] != 0;
+  bool changed = payload_changed(&responseFingerprints[updateType], fingerprint);
+  if(known){
+    int sample = changed ? CHANGE_RATE_ONE : 0;
+    changeRates[updateType] += (sample - changeRates[updateType]) / CHANGE_RATE_WEIGHT;
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"response_changed:Type %d change rate %d/%d",
+            updateType,changeRates[updateType],CHANGE_RATE_ONE);
+    #endif
+  }
+  return changed;
+}
+
+/**
+*Gets an update type's interval from its change rate, before subscriptions,
+*battery scaling or resting are considered
+*@param updateType the update type
+*@return the update interval in seconds. Events and Pebble stats always use
+*their update frequency.
+*/
+static int adaptive_interval(UpdateType updateType){
+  if(updateType == UPDATE_TYPE_EVENT || updateType == UPDATE_TYPE_PEBBLE_STATS)
+    return updateFreq[updateType];
+  int minFreq = updateBounds[updateType].minFreq;
+  int maxFreq = updateBounds[updateType].maxFreq;
+  if(minFreq == 0)minFreq = updateFreq[updateType];
+  if(maxFreq == 0)maxFreq = updateFreq[updateType] * DEFAULT_MAX_FREQ_FACTOR;
+  if(maxFreq < minFreq)maxFreq = minFreq;
+  return maxFreq - (int)((int64_t)(maxFreq - minFreq) * changeRates[updateType] / CHANGE_RATE_ONE);
+}
+
+/**
+*Gets how often an update type should be requested. This is the single place
+*update intervals are decided.
+*@param updateType the update type
+*@return the update interval in seconds
+*/
+static int effective_interval(UpdateType updateType){
+  //Pushed types only need an occasional poll in case a push was lost
+  int interval = adaptive_interval(updateType);
+  //A fitted phone battery rate only needs a new reading once its prediction is
+  //unreliable. That time is already exact, so it isn't scaled by battery band.
+  bool predicted = updateType == UPDATE_TYPE_BATTERY && get_phone_battery_refresh_time() != 0;
+  if(predicted){
+    interval = get_phone_battery_refresh_time() - lastUpdate[updateType];
+    if(interval < 0)interval = 0;
+  }
+  if((subscribedTypes & (1 << updateType)) && interval < SUBSCRIBED_UPDATE_FREQ)
+    interval = SUBSCRIBED_UPDATE_FREQ;
+  //Tighten while charging, and back off as the watch battery runs down
+  if(!predicted)interval = (int)((int64_t) interval * intervalScales[batteryBand][updateType] / 100);
+  if(resting && updateType == UPDATE_TYPE_EVENT && interval < RESTING_EVENT_FREQ)
+    interval = RESTING_EVENT_FREQ;
+  //A stored forecast keeps weather current until shortly before it runs out
+  if(updateType == UPDATE_TYPE_WEATHER && get_forecast_end() != 0){
+    int forecastInterval = get_forecast_end() - FORECAST_REFRESH_MARGIN - lastUpdate[updateType];
+    if(forecastInterval > interval)interval = forecastInterval;
+  }
+  return interval;
+}
+
+/**
+*Gets when an update type should next be requested
+*@param updateType the update type
+*@return the next due time. Types awaiting a response aren't due again until
+*the response times out. Only events are due while resting, the schedule is
+*rebuilt once resting ends.
+*/
+static time_t next_due_time(UpdateType updateType){
+  if(resting && updateType != UPDATE_TYPE_EVENT)return NEVER_DUE;
+  time_t due = lastUpdate[updateType] + effective_interval(updateType) + 1;
+  if((awaitingResponse & (1 << updateType)) && due < requestTimes[updateType] + RESPONSE_TIMEOUT)
+    due = requestTimes[updateType] + RESPONSE_TIMEOUT;
+  return due;
+}
+
+/**
+*Rebuilds the schedule heap from current update due times
+*/
+static void build_schedule(){
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    schedule[i].type = i;
+    schedule[i].due = next_due_time(i);
+  }
+  heapify_schedule();
+  scheduleChanged = false;
+}
+
+/**
+*Restores the heap order of every schedule entry
+*/
+static void heapify_schedule(){
+  for(int i = NUM_UPDATE_TYPES / 2 - 1; i >= 0; i--)schedule_sift_down(i, NUM_UPDATE_TYPES);
+}
+
+/**
+*Moves a schedule entry down the heap until it's due no later than its children
+*@param index the entry's heap index
+*@param size the number of entries in the heap
+*/
+static void schedule_sift_down(int index, int size){
+  while(2 * index + 1 < size){
+    int child = 2 * index + 1;
+    if(child + 1 < size && schedule[child + 1].due < schedule[child].due)child++;
+    if(schedule[index].due <= schedule[child].due)return;
+    ScheduleEntry swap = schedule[index];
+    schedule[index] = schedule[child];
+    schedule[child] = swap;
+    index = child;
+  }
+}
+
+/**
+*Ends a bulk event sync, shrinking the inbox back to its normal size
+*/
+static void end_bulk_sync(){
+  if(bulkTimer != NULL){
+    app_timer_cancel(bulkTimer);
+    bulkTimer = NULL;
+  }
+  end_bulk_transfer();
+}
+
+/**
+*Ends any bulk event sync once the message being received has been
+*processed, as reopening AppMessage frees the inbox holding it. Call
+*this after the last message of the sync.
+*/
+static void finish_bulk_sync(){
+  if(bulkTimer != NULL)app_timer_reschedule(bulkTimer, 0);
+}
+
+/**
+*Ends a bulk event sync after its last message was received, or once it
+*times out
+*@param data unused callback data
+*/
+static void bulk_sync_timeout(void * data){
+  bulkTimer = NULL;
+  end_bulk_sync();
+}
+
+/**
+*Gets the battery band for a watch battery state
+*@param charge the watch battery state
+*@return the BatteryBand update intervals should be scaled for
+*/
+static BatteryBand get_battery_band(BatteryChargeState charge){
+  if(charge.is_plugged || charge.is_charging)return BATTERY_BAND_CHARGING;
+  if(charge.charge_percent < BATTERY_LOW_PERCENT)return BATTERY_BAND_LOW;
+  if(charge.charge_percent < BATTERY_MEDIUM_PERCENT)return BATTERY_BAND_MEDIUM;
+  return BATTERY_BAND_HIGH;
+}
+
+/**
+*Checks if a time falls within quiet hours
+*@param now the time to check
+*@return true if quiet hours are enabled and include now
+*/
+static bool in_quiet_hours(time_t now){
+  if(quietHoursStart == quietHoursEnd)return false;
+  struct tm * local = localtime(&now);
+  int minute = local->tm_hour * 60 + local->tm_min;
+  if(quietHoursStart < quietHoursEnd)return minute >= quietHoursStart && minute < quietHoursEnd;
+  return minute >= quietHoursStart || minute < quietHoursEnd;//Quiet hours cross midnight
+}
+
+/**
+*Checks if polling should be suspended
+*@param now the current time
+*@return true during quiet hours, or if the watch hasn't moved in INACTIVITY_WINDOW
+*/
+static bool is_resting(time_t now){
+  return in_quiet_hours(now) || now - lastMovement >= INACTIVITY_WINDOW;
+}
+
+/**
+*Checks a batch of accelerometer samples for wrist movement. Movement is
+*recorded, and catches up on skipped updates if it ends a period of inactivity.
+*@param data the accelerometer samples
+*@param num_samples the number of samples
+*/
+static void accel_data_handler(AccelData * data, uint32_t num_samples){
+  bool moved = false;
+  for(uint32_t i = 1; i < num_samples && !moved; i++){
+    //Vibration shakes the watch without the wrist moving
+    if(data[i].did_vibrate || data[i-1].did_vibrate)continue;
+    int change = abs(data[i].x - data[i-1].x) + abs(data[i].y - data[i-1].y) +
+                 abs(data[i].z - data[i-1].z);
+    moved = change >= MOVEMENT_THRESHOLD;
+  }
+  if(!moved)return;
+  lastMovement = time(NULL);
+  if(!resting || is_resting(lastMovement))return;
+  #ifdef DEBUG_MESSAGING
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"accel_data_handler:Movement after inactivity, catching up");
+  #endif
+  resting = false;
+  scheduleChanged = true;
+  if(connection_service_peek_pebble_app_connection())catch_up_updates();
+}
+
+/**
+*Rescales update intervals when the watch battery changes band
+*@param charge the new watch battery state
+*/
+static void battery_state_handler(BatteryChargeState charge){
+  BatteryBand band = get_battery_band(charge);
+  if(band == batteryBand)return;
+  #ifdef DEBUG_MESSAGING
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"battery_state_handler:Battery band %d",band);
+  #endif
+  batteryBand = band;
+  scheduleChanged = true;
+}
+
 static void process_message(DictionaryIterator *iterator){
   if(appContacted == 0){//First contact, send info and request updates
     appContacted = 1;
+    subscribe();
     request_update(UPDATE_TYPE_PEBBLE_STATS);
     request_update(UPDATE_TYPE_EVENT);
     request_update(UPDATE_TYPE_BATTERY);
     request_update(UPDATE_TYPE_INFOTEXT);
     request_update(UPDATE_TYPE_WEATHER);
   }
-  Tuple *message_code = dict_find(iterator,KEY_MESSAGE_CODE);
-  if(message_code != NULL){
-    switch((AndroidMessageCode) message_code->value->int32){
-      case CODE_EVENT_RESPONSE:{
-        #ifdef DEBUG_MESSAGING
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_EVENT_RESPONSE");
-        #endif
-        lastUpdate[UPDATE_TYPE_EVENT] = time(NULL);//set last event update time
-        Tuple *title = dict_find(iterator,KEY_EVENT_TITLE);
-        Tuple *start = dict_find(iterator,KEY_EVENT_START);
-        Tuple *end = dict_find(iterator,KEY_EVENT_END);
-        Tuple *color = dict_find(iterator,KEY_EVENT_COLOR);
-        Tuple *num = dict_find(iterator,KEY_EVENT_NUM);  
-        if((title != NULL)&&(start != NULL)&&(end != NULL)&&
-           (color != NULL)&&(num != NULL)){
-        add_event(num->value->int32,
-                 title->value->cstring,
-                 start->value->int32,
-                 end->value->int32,
-                 color->value->cstring);   
-        }
-        break;
-      }     
-      case CODE_BATTERY_RESPONSE:{
-        #ifdef DEBUG_MESSAGING
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_BATTERY_RESPONSE");
-        #endif
-        lastUpdate[UPDATE_TYPE_BATTERY] = time(NULL);
-        Tuple *battery = dict_find(iterator,KEY_BATTERY_UPDATE);
-        if(battery != NULL){
-          #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Getting battery info");
-          #endif
-          update_text(battery->value->cstring,TEXT_PHONE_BATTERY);
+  InboxMessage message;
+  read_message(iterator, &message);
+  if(!RECEIVED(&message, IN_MESSAGE_CODE)){
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_ERROR, "inbox_dropped_callback:Received message with no message code!");
+    #endif
+    return;
+  }
+  TRACE("R %d", (int)message.messageCode);
+  //Responses identical to the last one applied only update their update time
+  uint32_t fingerprint = hash_bytes(FNV_OFFSET_BASIS, iterator->dictionary, dict_size(iterator));
+  switch((AndroidMessageCode) message.messageCode){
+    case CODE_EVENT_RESPONSE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_EVENT_RESPONSE");
+      #endif
+      response_received(UPDATE_TYPE_EVENT);//set last event update time
+      //add_event compares against the stored event, so repeated events cost no writes
+      if(RECEIVED(&message, IN_PACKED_EVENT) &&
+         read_packed_event(message.packedEvent))break;
+      if(RECEIVED(&message, IN_EVENT_TITLE) && RECEIVED(&message, IN_EVENT_START) &&
+         RECEIVED(&message, IN_EVENT_END) && RECEIVED(&message, IN_EVENT_COLOR) &&
+         RECEIVED(&message, IN_EVENT_NUM)){
+        add_event(message.eventNum,
+                  RECEIVED(&message, IN_EVENT_ID) ? (uint32_t) message.eventID : 0,
+                  message.eventTitle,
+                  message.eventStart,
+                  message.eventEnd,
+                  hex_string_to_gcolor(message.eventColor));
+      }
+      break;
+    case CODE_EVENTS_UNCHANGED:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_EVENTS_UNCHANGED");
+      #endif
+      response_received(UPDATE_TYPE_EVENT);
+      finish_bulk_sync();
+      break;
+    case CODE_EVENT_DELETE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_EVENT_DELETE");
+      #endif
+      response_received(UPDATE_TYPE_EVENT);
+      if(RECEIVED(&message, IN_EVENT_ID))delete_event((uint32_t) message.eventID);
+      break;
+    case CODE_EVENT_LIST_RESPONSE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_EVENT_LIST_RESPONSE");
+      #endif
+      //Only count the response once the whole list has been applied
+      if(RECEIVED(&message, IN_PACKED_EVENT_LIST) &&
+         read_packed_event_list(message.packedEventList)){
+        response_received(UPDATE_TYPE_EVENT);
+        finish_bulk_sync();
+      }
+      break;
+    case CODE_BATTERY_RESPONSE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_BATTERY_RESPONSE");
+      #endif
+      response_received(UPDATE_TYPE_BATTERY);
+      //Repeated readings still extend the phone battery model, so they aren't skipped
+      response_changed(UPDATE_TYPE_BATTERY, fingerprint);
+      if(RECEIVED(&message, IN_PACKED_BATTERY) && read_packed_battery(message.packedBattery))break;
+      if(RECEIVED(&message, IN_BATTERY)){
+        //Legacy battery strings are a percentage, followed by '+' while charging
+        if(message.battery[0] >= '0' && message.battery[0] <= '9'){
+          add_phone_battery_reading(time(NULL), atoi(message.battery),
+                                    strchr(message.battery, '+') != NULL);
+        }else{
+          clear_phone_battery();
+          update_text(message.battery,TEXT_PHONE_BATTERY);
         }
+      }
+      break;
+    case CODE_INFOTEXT_RESPONSE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_INFOTEXT_RESPONSE");
+      #endif
+      response_received(UPDATE_TYPE_INFOTEXT);
+      if(!response_changed(UPDATE_TYPE_INFOTEXT, fingerprint))break;
+      if(RECEIVED(&message, IN_INFOTEXT))update_text(message.infoText,TEXT_INFOTEXT);
+      break;
+    case CODE_WEATHER_RESPONSE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_WEATHER_RESPONSE");
+      #endif
+      response_received(UPDATE_TYPE_WEATHER);//set last weather update time
+      if(!response_changed(UPDATE_TYPE_WEATHER, fingerprint))break;
+      if(RECEIVED(&message, IN_PACKED_FORECAST) && read_packed_forecast(message.packedForecast))
         break;
-      }    
-      case CODE_INFOTEXT_RESPONSE:{
-        #ifdef DEBUG_MESSAGING
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_INFOTEXT_RESPONSE");
-        #endif
-        lastUpdate[UPDATE_TYPE_INFOTEXT] = time(NULL);
-        Tuple *infoText = dict_find(iterator,KEY_INFOTEXT);
-        if(infoText != NULL){
-          #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Getting infoText");
-          #endif
-          update_text(infoText->value->cstring,TEXT_INFOTEXT);
-        }
-        break;
-      }  
-      case CODE_WEATHER_RESPONSE:{
-        #ifdef DEBUG_MESSAGING
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_WEATHER_RESPONSE");
-        #endif
-        lastUpdate[UPDATE_TYPE_WEATHER] = time(NULL);//set last weather update time
-        Tuple * temp = dict_find(iterator,KEY_TEMPERATURE);
-        Tuple * cond = dict_find(iterator,KEY_WEATHER_COND);
-  
-        if(temp != NULL && cond != NULL){
-          #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Getting weather info");
-          #endif
-          update_weather(temp->value->int32,cond->value->int32);
-        }
+      //Current weather replaces any stored forecast
+      if(RECEIVED(&message, IN_PACKED_WEATHER) && read_packed_weather(message.packedWeather)){
+        clear_forecast();
         break;
       }
-      case CODE_COLOR_UPDATE:{
-        #ifdef DEBUG_MESSAGING
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_COLOR_UPDATE");
-        #endif
-        Tuple * theme = dict_find(iterator,KEY_DISPLAY_THEME);//check for theme update
-        if(theme != NULL){
-          set_theme(theme->value->int32);
-          
-        char newColors [NUM_COLORS][7];
-        for(int i=0;i<NUM_COLORS;i++){
-          Tuple * color = dict_find(iterator,KEY_COLORS_BEGIN+i);
-          if(color != NULL){
-            strncpy(newColors[i],color->value->cstring,sizeof(newColors[i]));
-          }else strncpy (newColors[i],"",sizeof(newColors[i]));//default to empty string if not updating color
-        }
-        update_colors(newColors);
-        break;
+      if(RECEIVED(&message, IN_TEMPERATURE) && RECEIVED(&message, IN_WEATHER_COND)){
+        clear_forecast();
+        update_weather(message.temperature,message.weatherCond);
       }
-      case CODE_PEBBLE_STATS_REQUEST:{
-        //Send out a message just carrying extra data
-        #ifdef DEBUG_MESSAGING
-        APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved stats request");
-        #endif
-        request_update(UPDATE_TYPE_PEBBLE_STATS);
-        break;
-        }
+      break;
+    case CODE_COLOR_UPDATE:{
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_COLOR_UPDATE");
+      #endif
+      if(RECEIVED(&message, IN_PACKED_COLORS) && read_packed_colors(message.packedColors))break;
+      if(RECEIVED(&message, IN_DISPLAY_THEME))set_theme(message.theme);//check for theme update
+      char newColors [NUM_COLORS][7];
+      for(int i=0;i<NUM_COLORS;i++){
+        if(RECEIVED(&message, IN_COLORS_BEGIN + i)){
+          strncpy(newColors[i],message.colors[i],sizeof(newColors[i]));
+          newColors[i][sizeof(newColors[i]) - 1] = '\0';
+        }else strncpy (newColors[i],"",sizeof(newColors[i]));//default to empty string if not updating color
       }
-    }   
-  
-    //Save new update frequencies, if received
-    for(int i=0;i<NUM_UPDATE_TYPES;i++){
-      Tuple * newFreq = dict_find(iterator,KEY_UPDATE_FREQS_BEGIN+i);
-      if(newFreq != NULL)
-        updateFreq[i] = newFreq->value->int32;
+      update_colors(newColors);
+      break;
     }
-    //Save date format, if received
-    Tuple * dateFormat = dict_find(iterator,KEY_DATE_FORMAT);
-    if(dateFormat != NULL)
-      set_date_format(dateFormat->value->cstring); 
-    Tuple * futureEventTimeFormat = dict_find(iterator,KEY_FUTURE_EVENT_TIME_FORMAT);
-    if(futureEventTimeFormat != NULL)
-      setFutureEventTimeFormat(futureEventTimeFormat->value->int32);  
+    case CODE_PEBBLE_STATS_REQUEST:
+      //Send out a message just carrying extra data
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved stats request");
+      #endif
+      sessionStarted = false;//Resend everything in case Android lost its cached values
+      subscribedTypes = 0;
+      subscribe();
+      request_update(UPDATE_TYPE_PEBBLE_STATS);
+      break;
+    case CODE_SUBSCRIPTION_ACK:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_SUBSCRIPTION_ACK");
+      #endif
+      if(RECEIVED(&message, IN_SUBSCRIBED_TYPES))
+        subscribedTypes = message.subscribedTypes & ~(1 << UPDATE_TYPE_PEBBLE_STATS);
+      break;
+    case CODE_SETTINGS_UPDATE:
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Recieved CODE_SETTINGS_UPDATE");
+      #endif
+      break;//Settings are read below, as with any message
+  }
+  scheduleChanged = true;//Update times, frequencies or subscriptions may have changed
+  //Save new update frequencies and priorities, if received
+  for(int i=0;i<NUM_UPDATE_TYPES;i++){
+    if(RECEIVED(&message, IN_UPDATE_FREQS_BEGIN + i))
+      updateFreq[i] = message.updateFreqs[i];
+    if(RECEIVED(&message, IN_UPDATE_PRIORITIES_BEGIN + i)){
+      int32_t priority = message.updatePriorities[i];
+      if(priority < 0)priority = 0;
+      if(priority > MAX_UPDATE_PRIORITY)priority = MAX_UPDATE_PRIORITY;
+      updatePriority[i] = priority;
+    }
+  }
+  if(RECEIVED(&message, IN_INTERVAL_SCALES))read_interval_scales(message.packedIntervalScales);
+  if(RECEIVED(&message, IN_UPDATE_BOUNDS))read_update_bounds(message.packedUpdateBounds);
+  //Save quiet hours, if received
+  if(RECEIVED(&message, IN_QUIET_HOURS_START) && RECEIVED(&message, IN_QUIET_HOURS_END)){
+    bool valid = message.quietHoursStart >= 0 && message.quietHoursStart < MINUTES_PER_DAY
+      && message.quietHoursEnd >= 0 && message.quietHoursEnd < MINUTES_PER_DAY;
+    quietHoursStart = valid ? message.quietHoursStart : 0;
+    quietHoursEnd = valid ? message.quietHoursEnd : 0;
+    persist_write_int(PERSIST_KEY_QUIET_HOURS_START, quietHoursStart);
+    persist_write_int(PERSIST_KEY_QUIET_HOURS_END, quietHoursEnd);
+  }
+  //Save date format, if received
+  if(!(RECEIVED(&message, IN_PACKED_SETTINGS) && read_packed_settings(message.packedSettings))){
+    if(RECEIVED(&message, IN_DATE_FORMAT))
+      set_date_format(message.dateFormat);
+    if(RECEIVED(&message, IN_FUTURE_EVENT_TIME_FORMAT))
+      setFutureEventTimeFormat(message.futureEventTimeFormat);
+  }
+}
+
+/**
+*Stores an event from a packed event payload
+*@param tuple the KEY_PACKED_EVENT tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_packed_event(Tuple * tuple){
+  CodecReader reader;
+  CodecEventBase base;
+  CodecEvent event;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_event_base(&reader, &base) ||
+     !codec_read_event(&reader, &event))return false;
+  time_t start = (time_t) base.base + event.start;
+  add_event(event.num, event.id, event.title, start, start + event.duration, event.color);
+  return true;
+}
+
+/**
+*Stages one part of a packed event list, and replaces all stored events
+*with the list once every part has been received
+*@param tuple the KEY_PACKED_EVENT_LIST tuple
+*@return true if this part completed the list, false if more parts are
+*needed or the payload was invalid
+*/
+static bool read_packed_event_list(Tuple * tuple){
+  CodecReader reader;
+  CodecEventBase base;
+  CodecEventList header;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_event_base(&reader, &base) ||
+     !codec_read_event_list(&reader, &header) ||
+     header.numParts == 0 || header.numParts > 32 || header.part >= header.numParts){
+    return false;
   }
+  //A new list replaces any unfinished one
+  if(header.part == 0 || header.numParts != eventList.numParts){
+    eventList.numParts = header.numParts;
+    eventList.receivedParts = 0;
+    eventList.listedSlots = 0;
+  }
+  for(int i = 0; i < header.count; i++){
+    CodecEvent event;
+    if(!codec_read_event(&reader, &event))return false;
+    if(event.num >= NUM_EVENTS)continue;
+    eventList.events[event.num] = event;
+    eventList.starts[event.num] = (time_t) base.base + event.start;
+    eventList.listedSlots |= 1 << event.num;
+  }
+  eventList.receivedParts |= (uint32_t) 1 << header.part;
+  uint32_t allParts = header.numParts == 32 ? 0xFFFFFFFF : ((uint32_t) 1 << header.numParts) - 1;
+  if(eventList.receivedParts != allParts)return false;
   #ifdef DEBUG_MESSAGING
-  else APP_LOG(APP_LOG_LEVEL_ERROR, "inbox_dropped_callback:Received message with no message code!");
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"read_packed_event_list:Applying %d part event list",
+          header.numParts);
   #endif
+  events_begin_update();
+  for(int i = 0; i < NUM_EVENTS; i++){
+    if(eventList.listedSlots & (1 << i)){
+      CodecEvent * event = &eventList.events[i];
+      time_t start = eventList.starts[i];
+      add_event(i, event->id, event->title, start, start + event->duration, event->color);
+    }else delete_event_slot(i);
+  }
+  events_end_update();
+  eventList.numParts = 0;
+  eventList.receivedParts = 0;
+  eventList.listedSlots = 0;
+  return true;
+}
+
+/**
+*Updates weather from a packed weather payload
+*@param tuple the KEY_PACKED_WEATHER tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_packed_weather(Tuple * tuple){
+  CodecReader reader;
+  CodecWeather weather;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_weather(&reader, &weather))return false;
+  update_weather(weather.temperature, weather.condition);
+  return true;
+}
+
+/**
+*Stores a forecast from a packed forecast payload
+*@param tuple the KEY_PACKED_FORECAST tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_packed_forecast(Tuple * tuple){
+  CodecReader reader;
+  CodecForecast header;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_forecast(&reader, &header) ||
+     header.slotLength == 0 || header.slotLength > UINT16_MAX)return false;
+  if(header.count > MAX_FORECAST_SLOTS)header.count = MAX_FORECAST_SLOTS;
+  ForecastSlot slots[MAX_FORECAST_SLOTS];
+  for(int i = 0; i < header.count; i++){
+    CodecWeather weather;
+    if(!codec_read_weather(&reader, &weather))return false;
+    slots[i].temperature = weather.temperature;
+    slots[i].condition = weather.condition;
+  }
+  set_forecast(header.start, header.slotLength, slots, header.count);
+  return true;
+}
+
+/**
+*Replaces and saves update interval scales from a packed scale payload
+*@param tuple the KEY_INTERVAL_SCALES tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_interval_scales(Tuple * tuple){
+  CodecReader reader;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length))return false;
+  uint16_t scales[NUM_BATTERY_BANDS][NUM_UPDATE_TYPES];
+  for(int band = 0; band < NUM_BATTERY_BANDS; band++){
+    for(int type = 0; type < NUM_UPDATE_TYPES; type++){
+      CodecIntervalScale scale;
+      if(!codec_read_interval_scale(&reader, &scale))return false;
+      if(scale.percent < MIN_INTERVAL_SCALE)scale.percent = MIN_INTERVAL_SCALE;
+      if(scale.percent > MAX_INTERVAL_SCALE)scale.percent = MAX_INTERVAL_SCALE;
+      scales[band][type] = scale.percent;
+    }
+  }
+  memcpy(intervalScales, scales, sizeof(intervalScales));
+  persist_write_data(PERSIST_KEY_INTERVAL_SCALES, intervalScales, sizeof(intervalScales));
+  return true;
+}
+
+/**
+*Replaces and saves adaptive update interval bounds from a packed bounds payload
+*@param tuple the KEY_UPDATE_BOUNDS tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_update_bounds(Tuple * tuple){
+  CodecReader reader;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length))return false;
+  CodecUpdateBounds bounds[NUM_UPDATE_TYPES];
+  for(int i = 0; i < NUM_UPDATE_TYPES; i++){
+    if(!codec_read_update_bounds(&reader, &bounds[i]))return false;
+  }
+  memcpy(updateBounds, bounds, sizeof(updateBounds));
+  persist_write_data(PERSIST_KEY_UPDATE_BOUNDS, updateBounds, sizeof(updateBounds));
+  return true;
+}
+
+/**
+*Updates the theme and colors from a packed color payload
+*@param tuple the KEY_PACKED_COLORS tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_packed_colors(Tuple * tuple){
+  CodecReader reader;
+  CodecColors packed;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_colors(&reader, &packed))return false;
+  if(packed.theme != CODEC_NO_THEME)set_theme(packed.theme);
+  GColor newColors[NUM_COLORS];
+  newColors[BACKGROUND_COLOR] = packed.background;
+  newColors[FOREGROUND_COLOR] = packed.foreground;
+  newColors[LINE_COLOR] = packed.line;
+  newColors[TEXT_COLOR] = packed.text;
+  newColors[EVENT_0_COLOR] = packed.event0;
+  newColors[EVENT_1_COLOR] = packed.event1;
+  update_gcolors(newColors);
+  return true;
+}
+
+/**
+*Updates display settings from a packed settings payload
+*@param tuple the KEY_PACKED_SETTINGS tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_packed_settings(Tuple * tuple){
+  CodecReader reader;
+  CodecSettings settings;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_settings(&reader, &settings))return false;
+  set_date_format(settings.dateFormat);
+  setFutureEventTimeFormat(settings.futureEventTimeFormat);
+  return true;
+}
+
+/**
+*Records a phone battery reading from a packed battery payload
+*@param tuple the KEY_PACKED_BATTERY tuple
+*@return true if the payload was read, false if it was invalid
+*/
+static bool read_packed_battery(Tuple * tuple){
+  CodecReader reader;
+  CodecBattery battery;
+  if(!codec_begin(&reader, tuple->value->data, tuple->length) ||
+     !codec_read_battery(&reader, &battery))return false;
+  add_phone_battery_reading(time(NULL), battery.percent, battery.charging);
+  return true;
+}
+
+/**
+*Stages every value in a received message in a single pass
+*@param iterator the received message
+*@param message the InboxMessage to fill
+*/
+static void read_message(DictionaryIterator *iterator, InboxMessage * message){
+  message->received = 0;
+  for(Tuple * tuple = dict_read_first(iterator); tuple != NULL; tuple = dict_read_next(iterator)){
+    stage_tuple(message, tuple);
+  }
+}
+
+/**
+*Copies a received tuple into its InboxMessage value
+*@param message the InboxMessage being filled
+*@param tuple a received tuple. Tuples with unknown keys are ignored.
+*/
+static void stage_tuple(InboxMessage * message, Tuple * tuple){
+  if(tuple->key >= NUM_MESSAGE_KEYS || keyRoutes[tuple->key] == NO_ROUTE){
+    #ifdef DEBUG_MESSAGING
+    APP_LOG(APP_LOG_LEVEL_DEBUG,"stage_tuple:Ignoring unknown key %d",(int)tuple->key);
+    #endif
+    return;
+  }
+  const InboxRoute * route = &inboxRoutes[keyRoutes[tuple->key]];
+  int index = tuple->key - route->firstKey;
+  uint8_t * value = (uint8_t *) message + route->offset;
+  if(route->type == STAGE_CSTRING){
+    if(tuple->type != TUPLE_CSTRING)return;
+    ((char **) value)[index] = tuple->value->cstring;
+  }else if(route->type == STAGE_BYTE_ARRAY){
+    if(tuple->type != TUPLE_BYTE_ARRAY)return;
+    ((Tuple **) value)[index] = tuple;
+  }else if(!read_int(tuple, &((int32_t *) value)[index]))return;
+  message->received |= (uint64_t) 1 << (route->field + index);
+}
+
+/**
+*Reads an integer tuple of any width
+*@param tuple a received tuple
+*@param value set to the tuple's value, sign extended if the tuple is signed
+*@return true if the tuple held an integer, false otherwise
+*/
+static bool read_int(Tuple * tuple, int32_t * value){
+  bool isSigned = tuple->type == TUPLE_INT;
+  if(!isSigned && tuple->type != TUPLE_UINT)return false;
+  switch(tuple->length){
+    case 1:
+      *value = isSigned ? tuple->value->int8 : tuple->value->uint8;
+      return true;
+    case 2:
+      *value = isSigned ? tuple->value->int16 : tuple->value->uint16;
+      return true;
+    case 4:
+      *value = tuple->value->int32;
+      return true;
+    default:
+      return false;
+  }
 }
@@ -35,7 +35,14 @@ void messaging_deinit();
 void request_update(UpdateType updateType);
 
 /**
-*Gets the update frequency for a given request
+*Requests every update that is due. Updates that will be due soon are
+*requested in the same message, so the radio is woken less often.
+*/
+void request_due_updates();
+
+/**
+*Gets the update frequency for a given request. Update types Android
+*has agreed to push are only polled occasionally, as a fallback.
 *@param updateType the appropriate update request code
 *@return update frequency in seconds
 */
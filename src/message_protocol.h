@@ -0,0 +1,199 @@
+/**
+*@File message_protocol.h
+*AppMessage keys and message codes shared by the watch and the companion
+*app, and the rules for how messages are exchanged
+*/
+
+#pragma once
+
+//----------APPMESSAGE KEY DEFINITIONS----------
+enum{
+  KEY_MESSAGE_CODE,
+    //int32: identifying the purpose of the message, bi-directional
+  KEY_BATTERY_UPDATE,
+    //cstring: containing the sender's battery life percentage, bi-directional
+    //Pebble only sends this when it changes, see KEY_SESSION_START
+  KEY_EVENT_TITLE,
+    //cstring: an event's title string, sent from Android
+  KEY_EVENT_START,
+    //int32: event start time, sent from Android
+  KEY_EVENT_END,
+    //int32: event end time, sent from Android
+  KEY_EVENT_COLOR,
+    //cstring: event color, sent from Android
+  KEY_EVENT_NUM,
+    //int32: event index number, sent from Android
+  KEY_INFOTEXT,
+    //cstring: configurable information string, sent from Android
+  KEY_UPTIME,
+    //int32: current watchface uptime in seconds, sent from Pebble at session start
+  KEY_TOTAL_UPTIME,
+    //int32: total watchface uptime in seconds, sent from Pebble at session start
+  KEY_PEBBLE_MODEL,
+    //int32: pebble model as an enum WatchInfoModel, sent from Pebble at session start
+  KEY_PEBBLE_COLOR,
+    //int32: pebble color as an enum WatchInfoColor, sent from Pebble at session start
+  KEY_MODE_12_OR_24,
+    //int32: whether the pebble is set to 12 or 24 hour mode(as 12 or 24), sent from Pebble
+    //when changed
+  KEY_TEMPERATURE,
+    //int32: current temperature, sent from Android
+  KEY_WEATHER_COND,
+    //int32: an OpenWeatherAPI condition code, sent by Android
+  KEY_MEMORY_USED,
+    //int32: amount of memory used by the watchapp, sent from Pebble when changed
+  KEY_MEMORY_FREE,
+    //int32: amount of memory available for watchapp, sent from Pebble when changed
+  KEY_DATE_FORMAT,
+    //cstring: date format recognizable by strftime
+  KEY_FUTURE_EVENT_TIME_FORMAT,
+    //int32: index of the enum FutureEventFormat type selected, sent from Android
+  KEY_DISPLAY_THEME,
+    //int32: index of the enum Theme type selected, sent from Android
+  KEY_EVENT_SET_HASH,
+    //int32: hash of all event data stored on the Pebble, sent from Pebble with event requests
+    //See get_event_set_hash() in events.h for how it is calculated
+  KEY_EVENT_ID,
+    //int32: unique nonzero event ID, sent from Android with event responses
+  KEY_REQUEST_TYPES,
+    //int32: bitmask of requested update types, sent from Pebble with CODE_UPDATE_REQUEST
+    //Bit n requests UpdateType n, as defined in message_handler.h
+  KEY_SESSION_START,
+    //int32: always 1, sent from Pebble with the first request after launch or reconnection.
+    //Session start messages carry every Pebble info value. Android should cache them,
+    //as later requests only carry values that changed since the last delivered request.
+  KEY_CODEC_VERSION,
+    //int32: packed payload version the Pebble can read, sent from Pebble at session start.
+    //Android may send the packed keys below in place of the matching legacy keys.
+    //Payload layouts are defined in codec.h
+  KEY_PACKED_EVENT,
+    //byte array: one CODEC_EVENT_BASE_SCHEMA record followed by one CODEC_EVENT_SCHEMA
+    //record, replacing the KEY_EVENT_* keys in event responses
+  KEY_PACKED_WEATHER,
+    //byte array: one CODEC_WEATHER_SCHEMA record, replacing KEY_TEMPERATURE and
+    //KEY_WEATHER_COND in weather responses
+  KEY_PACKED_COLORS,
+    //byte array: one CODEC_COLORS_SCHEMA record, replacing KEY_DISPLAY_THEME and
+    //the KEY_COLORS_BEGIN keys in color updates
+  KEY_PACKED_SETTINGS,
+    //byte array: one CODEC_SETTINGS_SCHEMA record, replacing KEY_DATE_FORMAT and
+    //KEY_FUTURE_EVENT_TIME_FORMAT. Sent with CODE_SETTINGS_UPDATE.
+  KEY_PACKED_BATTERY,
+    //byte array: one CODEC_BATTERY_SCHEMA record, replacing KEY_BATTERY_UPDATE
+    //in battery responses
+  KEY_UPDATE_FREQS_BEGIN = 30,
+    //int32: First update frequency(seconds), sent from Android
+    //This begins a series of keys holding update frequencies for all update types
+    //Update types are defined in order in messaging.h
+  KEY_UPDATE_PRIORITIES_BEGIN = 40,
+    //int32: First update message priority, sent from Android
+    //This begins a series of keys holding message priorities for all update types,
+    //in the same order as KEY_UPDATE_FREQS_BEGIN. Higher priority requests are sent first.
+  KEY_COLORS_BEGIN = 50,
+    //cstring: Holds the first color string, sent by Android
+    //This is the first of a sequence of NUM_COLORS color keys
+    //NUM_COLORS is defined in display.h
+  KEY_PACKED_EVENT_LIST = 60,
+    //byte array: one CODEC_EVENT_BASE_SCHEMA record and one CODEC_EVENT_LIST_SCHEMA
+    //header followed by its CODEC_EVENT_SCHEMA records, sent with CODE_EVENT_LIST_RESPONSE
+  KEY_INBOX_SIZE,
+    //int32: size of the Pebble's open AppMessage inbox in bytes, sent from Pebble
+    //when changed. Android splits event lists into parts that fit this size.
+  KEY_SUBSCRIBED_TYPES,
+    //int32: bitmask of update types, bi-directional. Sent from Pebble with
+    //CODE_SUBSCRIBE to list the types it wants pushed, and returned by Android
+    //with CODE_SUBSCRIPTION_ACK to list the types it will push.
+  KEY_THRESHOLDS_BEGIN = 70,
+    //int32: First update type's change threshold, sent from Pebble with CODE_SUBSCRIBE
+    //This begins a series of keys holding thresholds for all update types, in the
+    //same order as KEY_UPDATE_FREQS_BEGIN. Android only pushes an update once its
+    //value changes by at least the threshold.
+  KEY_METRICS = 80,
+    //byte array: messaging metrics, sent from Pebble with CODE_PEBBLE_STATS_RESPONSE
+    //The layout is defined in messaging_core.h
+  KEY_PACKED_FORECAST,
+    //byte array: one CODEC_FORECAST_SCHEMA header followed by its CODEC_WEATHER_SCHEMA
+    //slot records, sent in place of current weather in weather responses
+  KEY_INTERVAL_SCALES,
+    //byte array: CODEC_INTERVAL_SCALE_SCHEMA records for every update type in each
+    //BatteryBand, sent from Android with CODE_SETTINGS_UPDATE.
+  KEY_QUIET_HOURS_START,
+    //int32: minutes after midnight that quiet hours begin, sent from Android.
+    //Sent with CODE_SETTINGS_UPDATE, always together with KEY_QUIET_HOURS_END.
+  KEY_QUIET_HOURS_END,
+    //int32: minutes after midnight that quiet hours end, sent from Android.
+    //Quiet hours are disabled if they begin and end at the same time.
+  KEY_UPDATE_BOUNDS,
+    //byte array: CODEC_UPDATE_BOUNDS_SCHEMA records for every update type, sent from
+    //Android with CODE_SETTINGS_UPDATE. Event and Pebble stats bounds are unused.
+  NUM_MESSAGE_KEYS
+};
+
+//----------APPMESSAGE MESSAGE CODES----------
+//Valid message codes for messages sent from Pebble
+typedef enum{
+  CODE_EVENT_REQUEST,
+    //Message requesting updated event info, replaced by CODE_UPDATE_REQUEST
+  CODE_BATTERY_REQUEST,
+    //Message requesting updated battery percentage, replaced by CODE_UPDATE_REQUEST
+  CODE_INFOTEXT_REQUEST,
+    //Message requesting updated infoText data, replaced by CODE_UPDATE_REQUEST
+  CODE_WEATHER_REQUEST,
+    //Message requesting updated weather data, replaced by CODE_UPDATE_REQUEST
+  CODE_PEBBLE_STATS_RESPONSE,
+    //Message providing messaging metrics in KEY_METRICS, sent whenever
+    //Pebble stats are sent
+  CODE_UPDATE_REQUEST,
+    //Message requesting every update type set in KEY_REQUEST_TYPES, and providing
+    //Pebble information if UPDATE_TYPE_PEBBLE_STATS is set
+  CODE_SUBSCRIBE
+    //Message asking Android to push changes to the update types in
+    //KEY_SUBSCRIBED_TYPES, using the KEY_THRESHOLDS_BEGIN thresholds
+} PebbleMessageCode;
+
+//Valid message codes for messages received from Android
+typedef enum{
+  CODE_EVENT_RESPONSE,
+    //Message providing updated event info
+  CODE_BATTERY_RESPONSE,
+    //Message providing updated battery percentage
+  CODE_INFOTEXT_RESPONSE,
+    //Message providing updated infoText data
+  CODE_WEATHER_RESPONSE,
+    //Message providing updated weather data
+  CODE_COLOR_UPDATE,
+    //Message providing updated color data
+  CODE_PEBBLE_STATS_REQUEST,
+    //Message requesting assorted Pebble information
+  CODE_EVENTS_UNCHANGED,
+    //Message confirming that the event set hash sent with an event request
+    //still matches the current events
+  CODE_EVENT_DELETE,
+    //Message removing the event with a given KEY_EVENT_ID
+  CODE_EVENT_LIST_RESPONSE,
+    //Message providing one part of the full event list in KEY_PACKED_EVENT_LIST
+  CODE_SUBSCRIPTION_ACK,
+    //Message confirming a CODE_SUBSCRIBE message, with the pushed update types
+    //in KEY_SUBSCRIBED_TYPES
+  CODE_SETTINGS_UPDATE
+    //Message providing only optional settings: update frequencies and priorities,
+    //interval scales, update bounds, quiet hours and display settings
+} AndroidMessageCode;
+
+//Event requests include KEY_EVENT_SET_HASH. If it matches the hash of the events
+//Android would send, Android replies with CODE_EVENTS_UNCHANGED. Otherwise it only
+//sends a CODE_EVENT_RESPONSE for each inserted or updated event, and a
+//CODE_EVENT_DELETE for each removed event.
+//For a full refresh, Android may instead send the whole event list in one
+//or more CODE_EVENT_LIST_RESPONSE parts, splitting it to fit the inbox. The
+//list is only applied once every part has arrived.
+//The inbox only fits one response, so optional settings are sent in their own
+//CODE_SETTINGS_UPDATE message. The first event request of each session opens a
+//bulk transfer with the largest possible inbox, and Android may add settings to
+//any message sent during it. The bulk transfer ends once the event list is
+//complete, Android replies with CODE_EVENTS_UNCHANGED, or RESPONSE_TIMEOUT passes.
+//Once Android acknowledges a subscription, it sends responses for subscribed
+//types without being asked whenever their values change. Pebble then only
+//polls those types every SUBSCRIBED_UPDATE_FREQ seconds, in case a push was lost.
+//RESPONSE_TIMEOUT and SUBSCRIBED_UPDATE_FREQ are defined in message_handler.c.
+//Subscriptions last until the connection drops, and are renewed each session.
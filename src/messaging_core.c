@@ -9,31 +9,113 @@
 #endif
 
 #define RESEND_TIME 60000 //Time to wait before assuming an outgoing message was lost
+//Initial retry delays(milliseconds) for each class of send failure. Each failed
+//attempt doubles the delay, up to RETRY_MAX_DELAY.
+#define RETRY_DELAY_BUSY 250 //Outbox or phone busy
+#define RETRY_DELAY_TIMEOUT 2000 //Message sent but not acknowledged
+#define RETRY_DELAY_DISCONNECTED 30000 //Phone or phone app unreachable
+#define RETRY_MAX_DELAY 900000 //Longest possible wait between retries
+#define RETRY_JITTER 25 //Percentage retry delays are randomly varied by
+#define QUEUE_SIZE 512 //Bytes available for queued outgoing messages
 
-//----------MESSAGE STACK STRUCTURE----------
+//----------MESSAGE QUEUE STRUCTURE----------
+//Queued messages are packed back to back in a ring buffer, each one
+//stored as a MessageHeader followed by its message descriptor.
+//Messages never cross the end of the buffer. Messages are sent highest
+//priority first, and in queue order within each priority.
+//New messages are added at the tail, and removed messages are only marked
+//as dropped. Dropped messages at the head are released by moving the head
+//forward, so adding a message and removing the oldest one take constant
+//time. Gaps left by messages removed from the middle are only compacted
+//when a new message doesn't fit. Picking the next message to send scans
+//the queued messages for the highest priority.
+typedef struct{
+  uint16_t size;//descriptor size in bytes, or 0 if the rest of the buffer is unused
+  uint8_t type;//message type, used to pick messages to drop when the queue is full
+  uint8_t dropped;//1 if the message is being removed from the queue
+  uint8_t attempts;//number of failed attempts to send the message
+  uint8_t priority;//message priority, higher priority messages are sent first
+  uint8_t sending;//1 if this is the message currently being sent
+  uint32_t deadline;//time when the message is dropped if unsent, or 0 if it never expires
+}MessageHeader;
 
-typedef struct msgStack{
-  uint8_t buffer[DICT_SIZE];//Message dictionary buffer
-  struct msgStack * next;//Link to the next message
-}MessageStack;
+//Number of queue bytes used by a message, keeping headers aligned
+#define RECORD_SIZE(dataSize) ((sizeof(MessageHeader) + (dataSize) + 3) & ~3)
 
 //----------LOCAL VARIABLES----------
-MessageStack * messageStack = NULL; //Unsent message stack
-int messageStackSize = 0;//Number of messages on the stack
+static uint8_t messageQueue[QUEUE_SIZE] __attribute__((aligned(4)));//Unsent message ring buffer
+static uint16_t queueHead = 0;//Offset of the oldest queued message
+static uint16_t queueTail = 0;//Offset where the next message will be queued
+static uint16_t queueUsed = 0;//Queue bytes used, including skipped space at the buffer end
+static int queueCount = 0;//Number of messages in the buffer, including dropped messages
+static int droppedCount = 0;//Number of dropped messages not yet released from the buffer
+static uint16_t sendingOffset = 0;//Offset of the message being sent, if sendingMessage is true
 bool init = false;//Equals 1 iff messaging_init has been run
+static uint32_t inboxSize = DICT_SIZE;//Inbox size outside of bulk transfers
+static uint32_t outboxSize = DICT_SIZE;//Outbox size
+static uint32_t openInboxSize = 0;//Size of the currently open inbox
+static bool bulkMode = false;//True during a bulk transfer
+static bool resizePending = false;//True if AppMessage must be reopened once the outbox is idle
 
 bool sendingMessage = false;//tracks the state of the message sending process
 AppTimer * resend_timer = NULL;//Time until an ignored message should be re-sent
+static bool retryScheduled = false;//True if resend_timer is waiting to retry a failed message
 
 InboxHandler inbox_handler = NULL;//Function incoming messages are handed off to
+OutboxWriter outbox_writer = NULL;//Function that writes queued messages into the outbox
+OutboxSentHandler outbox_sent_handler = NULL;//Function notified when messages are acknowledged
+
+static const uint16_t latencyLimits[NUM_LATENCY_BUCKETS - 1] = {250, 500, 1000, 2500, 10000};
+  //Largest latency(milliseconds) counted in each latency bucket but the last
+static struct{
+  uint32_t bytesSent;
+  uint32_t bytesReceived;
+  uint16_t messagesSent;
+  uint16_t messagesReceived;
+  uint16_t retries;
+  uint16_t dropped;//unsent messages dropped
+  uint16_t queueHighWater;//most queue bytes used at once
+  uint16_t failures[METRICS_RESULTS];//send failures by AppMessageResult bit
+  uint16_t inboxDropped[METRICS_RESULTS];//incoming messages dropped by AppMessageResult bit
+  uint16_t latency[LATENCY_TYPES][NUM_LATENCY_BUCKETS];//response latency counts
+} metrics = {0};
+  //Messaging counters since launch
 
 //----------STATIC FUNCTION DECLARATIONS----------
+static MessageHeader * message_at(uint16_t offset);
+  //Gets the queued message stored at an offset
+static uint16_t next_message_offset(uint16_t offset);
+  //Gets the offset of the queued message after another message
+static MessageHeader * first_message();
+  //Gets the oldest queued message
+static MessageHeader * sending_message();
+  //Gets the message currently being sent
+static MessageHeader * next_message();
+  //Gets the message that should be sent next
+static bool reserve_message(uint16_t recordSize, uint16_t * offset);
+  //Reserves queue space for a new message
+static bool drop_message(uint8_t type, uint8_t priority);
+  //Removes an unsent message to make room in the queue
+static bool drop_expired_messages();
+  //Removes unsent messages that are past their deadline
+static void release_dropped_messages();
+  //Frees the space used by dropped messages at the head of the queue
+static void compact_queue();
+  //Removes dropped messages, moving later messages back to fill the gaps
+static void open_app_message();
+  //Registers AppMessage callbacks and opens AppMessage with the current buffer sizes
+static void resize_buffers();
+  //Reopens AppMessage with the current buffer sizes once the outbox is idle
 static void delete_message();
-  //Removes the first message in the queue
+  //Removes the message being sent from the queue
 static void send_message();
-  //Sends the first message in the queue
+  //Sends the highest priority message in the queue
 static void resend_message(void * data);
   //Re-sends an ignored message 
+static void schedule_retry(AppMessageResult reason);
+  //Schedules another attempt to send a message after a failure
+static uint32_t retry_delay(AppMessageResult reason, uint8_t attempts);
+  //Gets how long to wait before retrying a failed message
 static void inbox_received_callback(DictionaryIterator *iterator, void *context);
   //Automatically called whenever a message is recieved
 static void inbox_dropped_callback(AppMessageResult reason, void *context);
@@ -44,16 +126,17 @@ static void outbox_sent_callback(DictionaryIterator *iterator, void *context);
   //Automatically calls whenever sending a message succeeds
 static void log_result_info(AppMessageResult result);
   //Given an error appMessageResult, prints debug data explaining the result
+static void count(uint16_t * counter);
+  //Increments a metrics counter, stopping at its maximum value
+static uint8_t * write_u16(uint8_t * buffer, uint16_t value);
+  //Writes a little-endian 16 bit value
+static uint8_t * write_u32(uint8_t * buffer, uint32_t value);
+  //Writes a little-endian 32 bit value
 
 //Initialize messaging and open AppMessage
 void open_messaging(){
-  //Register AppMessage callbacks
-  app_message_register_inbox_received(inbox_received_callback);
-  app_message_register_inbox_dropped(inbox_dropped_callback);
-  app_message_register_outbox_failed(outbox_failed_callback);
-  app_message_register_outbox_sent(outbox_sent_callback);
-  // Open AppMessage
-  app_message_open(DICT_SIZE,DICT_SIZE);
+  open_app_message();
+  srand(time(NULL));//seed retry jitter
   init = true;
 }
 
@@ -61,12 +144,39 @@ void open_messaging(){
 void close_messaging(){
   if(init){
     //delete remaining messages
-    while(messageStack != NULL){
-      delete_message();
-    }
+    queueHead = queueTail = queueUsed = 0;
+    queueCount = droppedCount = 0;
     app_message_deregister_callbacks();
   }
   init = false;
+  resizePending = false;
+}
+
+//Sets the AppMessage inbox and outbox sizes
+void set_buffer_sizes(uint32_t newInboxSize, uint32_t newOutboxSize){
+  if(newInboxSize == inboxSize && newOutboxSize == outboxSize)return;
+  inboxSize = newInboxSize;
+  outboxSize = newOutboxSize;
+  resize_buffers();
+}
+
+//Starts a bulk transfer with the largest possible inbox
+void begin_bulk_transfer(){
+  if(bulkMode)return;
+  bulkMode = true;
+  resize_buffers();
+}
+
+//Ends a bulk transfer, shrinking the inbox back to its normal size
+void end_bulk_transfer(){
+  if(!bulkMode)return;
+  bulkMode = false;
+  resize_buffers();
+}
+
+//Gets the size of the open AppMessage inbox
+uint32_t get_inbox_size(){
+  return init ? openInboxSize : inboxSize;
 }
 
 //Registers a function to pass incoming messages
@@ -74,40 +184,107 @@ void register_inbox_handler(InboxHandler handler){
   inbox_handler = handler;
 }
 
+//Registers the function that writes queued messages into the outbox
+void register_outbox_writer(OutboxWriter writer){
+  outbox_writer = writer;
+}
+
+//Retries queued messages immediately, skipping any retry delay
+void resume_messaging(){
+  if(!retryScheduled)return;
+  MessageHeader * message = sending_message();
+  if(message != NULL)message->attempts = 0;
+  app_timer_cancel(resend_timer);
+  resend_timer = NULL;
+  retryScheduled = false;
+  send_message();
+}
+
+//Registers a function to notify whenever a message is acknowledged
+void register_outbox_sent_handler(OutboxSentHandler handler){
+  outbox_sent_handler = handler;
+}
+
+//Gets a millisecond timestamp for measuring response latency
+uint32_t messaging_time_ms(){
+  time_t seconds;
+  uint16_t milliseconds;
+  time_ms(&seconds, &milliseconds);
+  return (uint32_t) seconds * 1000 + milliseconds;
+}
+
+//Records how long a response took to arrive
+void record_response_latency(uint8_t type, uint32_t milliseconds){
+  if(type >= LATENCY_TYPES)return;
+  int bucket = 0;
+  while(bucket < NUM_LATENCY_BUCKETS - 1 && milliseconds > latencyLimits[bucket])bucket++;
+  count(&metrics.latency[type][bucket]);
+}
+
+//Writes messaging metrics into a buffer
+uint16_t write_messaging_metrics(uint8_t * buffer){
+  uint8_t * pos = buffer;
+  *pos++ = METRICS_VERSION;
+  pos = write_u32(pos, metrics.bytesSent);
+  pos = write_u32(pos, metrics.bytesReceived);
+  pos = write_u16(pos, metrics.messagesSent);
+  pos = write_u16(pos, metrics.messagesReceived);
+  pos = write_u16(pos, metrics.retries);
+  pos = write_u16(pos, metrics.dropped);
+  pos = write_u16(pos, metrics.queueHighWater);
+  for(int i = 0; i < METRICS_RESULTS; i++)pos = write_u16(pos, metrics.failures[i]);
+  for(int i = 0; i < METRICS_RESULTS; i++)pos = write_u16(pos, metrics.inboxDropped[i]);
+  for(int i = 0; i < LATENCY_TYPES; i++){
+    for(int j = 0; j < NUM_LATENCY_BUCKETS; j++)pos = write_u16(pos, metrics.latency[i][j]);
+  }
+  return pos - buffer;
+}
+
 /**
 *adds a new message to the queue
-*param dictBuf a dictionary buffer containing the new message
+*If the queue is full, the oldest unsent message of the same type
+*is dropped, or the oldest lowest priority unsent message if none share its type.
+*@param data the new message descriptor
+*@param size the descriptor size in bytes
+*@param type the message type
+*@param priority the message priority
+*@param lifetime seconds before the message expires, or 0 if it never expires
 */
-void add_message(uint8_t dictBuf[DICT_SIZE]){
+void add_message(const uint8_t * data, uint16_t size, uint8_t type, uint8_t priority, uint16_t lifetime){
   if(!connection_service_peek_pebble_app_connection()) return;//disable messaging if not connected
   if(!init)open_messaging();
-  if(messageStackSize > 10){
+  uint16_t recordSize = RECORD_SIZE(size);
+  uint16_t offset;
+  if(recordSize > QUEUE_SIZE){
+    APP_LOG(APP_LOG_LEVEL_ERROR,"add_message:Message is too large to queue!");
+    return;
+  }
+  if(queueUsed + recordSize > QUEUE_SIZE)drop_expired_messages();
+  while(!reserve_message(recordSize, &offset)){
+    //Reclaim space left by removed messages before dropping another one
+    if(droppedCount > 0){
+      compact_queue();
+      continue;
+    }
     #ifdef DEBUG_MESSAGING
-    APP_LOG(APP_LOG_LEVEL_ERROR,"add_message:Too many messages! Deleting old messages");
+    APP_LOG(APP_LOG_LEVEL_ERROR,"add_message:Queue full! Dropping an old message");
     #endif
-    while(messageStackSize >0) delete_message();
-  }
-  #ifdef DEBUG_MESSAGING
-    APP_LOG(APP_LOG_LEVEL_DEBUG,"add_message:New message content:");
-    DictionaryIterator read;
-    dict_read_begin_from_buffer(&read, dictBuf, DICT_SIZE);
-    debugDictionary(&read);
-  #endif
-  
-  MessageStack ** index = &messageStack;
-  while(*index != NULL){
-    index = &((*index)->next);
-  }
-  //allocate message
-  *index = malloc(sizeof(MessageStack));
-  if(*index == NULL){
-    APP_LOG(APP_LOG_LEVEL_ERROR,"add_message:Out of memory!");
-    return;
+    if(!drop_message(type, priority)){
+      APP_LOG(APP_LOG_LEVEL_ERROR,"add_message:No room in the message queue!");
+      return;
+    }
   }
-  //copy over dictionary buffer
-  memcpy((*index)->buffer, dictBuf, DICT_SIZE);
-  (*index)->next = NULL;
-  messageStackSize++;
+  MessageHeader * message = message_at(offset);
+  message->size = size;
+  message->type = type;
+  message->dropped = 0;
+  message->attempts = 0;
+  message->priority = priority;
+  message->sending = 0;
+  message->deadline = lifetime > 0 ? time(NULL) + lifetime : 0;
+  memcpy(message + 1, data, size);
+  TRACE("q %d %d %d %d", type, priority, size, queueCount - droppedCount);
+  if(queueUsed > metrics.queueHighWater)metrics.queueHighWater = queueUsed;
   #ifdef DEBUG_MESSAGING
     APP_LOG(APP_LOG_LEVEL_DEBUG,"add_message:Added message to queue");
   #endif
@@ -116,63 +293,41 @@ void add_message(uint8_t dictBuf[DICT_SIZE]){
 }
 
 /**
-*Sends the first message in the queue
+*Sends the highest priority message in the queue
 */
 static void send_message(){
   if(!connection_service_peek_pebble_app_connection()) return;//disable messaging if not connected
   if(!init)open_messaging();
-  if(messageStack == NULL)return;
+  //No message is in flight until the next one is sent
+  MessageHeader * message = sending_message();
+  if(message != NULL)message->sending = 0;
+  sendingMessage = false;
+  if(resizePending)resize_buffers();
+  drop_expired_messages();
+  message = next_message();
+  if(message == NULL)return;
+  message->sending = 1;
+  sendingOffset = (uint8_t *) message - messageQueue;
   sendingMessage = true;
   #ifdef DEBUG_MESSAGING
     APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Retrieved message from queue");
   #endif
-  DictionaryIterator read,*send;
-  app_message_outbox_begin(&send);
-  #ifdef DEBUG_MESSAGING
-    APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Copying message data");
-  #endif
-  Tuple * dictItem = dict_read_begin_from_buffer(&read, messageStack->buffer, DICT_SIZE);
-  while(dictItem != NULL && dictItem->length > 0){
-    uint32_t key = dictItem->key;
-    uint16_t size = dictItem->length;
-    switch(dictItem->type){
-      case TUPLE_BYTE_ARRAY:
-        #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Writing byte array for key %d",(int)key);
-        #endif
-        dict_write_data(send,key,dictItem->value->data,size);
-        break;
-      case TUPLE_CSTRING:
-        #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Writing string %s for key %d"
-                       ,dictItem->value->cstring,(int)key);
-        #endif
-        dict_write_cstring(send, key, dictItem->value->cstring);
-        break;
-      case TUPLE_UINT:
-      {
-        uint32_t val = dictItem->value->uint32;
-        #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Writing int for key %d",(int)key);
-        #endif
-        dict_write_int(send,key,(int *)&val,size,false);
-        break;
-      }
-      case TUPLE_INT:
-      {
-        #ifdef DEBUG_MESSAGING
-          APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Writing int for key %d",(int)key);
-        #endif
-        int32_t val = dictItem->value->int32;
-        dict_write_int(send,key,(int *)&val,size,true);
-      }   
-    }
-    dictItem = dict_read_next(&read);
+  DictionaryIterator *send;
+  AppMessageResult result = app_message_outbox_begin(&send);
+  if(result != APP_MSG_OK || outbox_writer == NULL){
+    APP_LOG(APP_LOG_LEVEL_ERROR,"send_message:Couldn't open the outbox!");
+    log_result_info(result);
+    schedule_retry(result);
+    return;
   }
-  
+  //Write the message directly into the outbox buffer
+  outbox_writer(send, (uint8_t *)(message + 1), message->size);
+  uint32_t bytes = dict_write_end(send);
+  metrics.bytesSent += bytes;
+  count(&metrics.messagesSent);
+  TRACE("s %d %d %d", message->type, message->attempts, (int)bytes);
   #ifdef DEBUG_MESSAGING
     APP_LOG(APP_LOG_LEVEL_DEBUG,"send_message:Sending message");
-    debugDictionary(&read);
   #endif
   app_message_outbox_send();
   //Set a timer to re-send the message if it is ignored
@@ -181,15 +336,264 @@ static void send_message(){
 }
 
 /**
-*Removes the first message in the queue
+*Gets the queued message stored at an offset
+*@param offset a message offset in the queue buffer
+*@return the message header
+*/
+static MessageHeader * message_at(uint16_t offset){
+  return (MessageHeader *)(messageQueue + offset);
+}
+
+/**
+*Gets the offset of the queued message after another message
+*@param offset a queued message's offset
+*@pre another message is queued after the message at offset
+*@return the next message's offset
+*/
+static uint16_t next_message_offset(uint16_t offset){
+  offset += RECORD_SIZE(message_at(offset)->size);
+  //If the next message didn't fit before the buffer end, it's at the start
+  if(offset + sizeof(MessageHeader) > QUEUE_SIZE || message_at(offset)->size == 0) return 0;
+  return offset;
+}
+
+/**
+*Gets the oldest queued message
+*@return the message, or NULL if the queue is empty
+*/
+static MessageHeader * first_message(){
+  if(queueCount == 0)return NULL;
+  //Skip unused space at the buffer end
+  if(queueHead + sizeof(MessageHeader) > QUEUE_SIZE || message_at(queueHead)->size == 0){
+    queueUsed -= QUEUE_SIZE - queueHead;
+    queueHead = 0;
+  }
+  return message_at(queueHead);
+}
+
+/**
+*Gets the message currently being sent
+*@return the message, or NULL if no message is being sent
+*/
+static MessageHeader * sending_message(){
+  if(!sendingMessage || queueCount == 0)return NULL;
+  return message_at(sendingOffset);
+}
+
+/**
+*Gets the message that should be sent next
+*@return the oldest message with the highest priority, or NULL
+*if the queue is empty
+*/
+static MessageHeader * next_message(){
+  MessageHeader * next = first_message();
+  if(next == NULL)return NULL;
+  uint16_t offset = queueHead;
+  for(int i = 1; i < queueCount; i++){
+    offset = next_message_offset(offset);
+    MessageHeader * message = message_at(offset);
+    if(!message->dropped && message->priority > next->priority)next = message;
+  }
+  return next;
+}
+
+/**
+*Reserves queue space for a new message
+*@param recordSize queue bytes needed for the message
+*@param offset set to the reserved space's offset
+*@return true if space was reserved, false if the queue is too full
+*/
+static bool reserve_message(uint16_t recordSize, uint16_t * offset){
+  if(queueCount == 0){
+    queueHead = queueTail = queueUsed = 0;
+    droppedCount = 0;
+  }
+  bool wrapped = queueCount > 0 && queueTail <= queueHead;
+  if(!wrapped && queueTail + recordSize <= QUEUE_SIZE) *offset = queueTail;
+  else if(!wrapped && recordSize <= queueHead){//continue from the buffer start
+    if(queueTail + sizeof(MessageHeader) <= QUEUE_SIZE) message_at(queueTail)->size = 0;
+    queueUsed += QUEUE_SIZE - queueTail;
+    *offset = 0;
+  }
+  else if(wrapped && queueTail + recordSize <= queueHead) *offset = queueTail;
+  else return false;
+  queueTail = *offset + recordSize;
+  queueUsed += recordSize;
+  queueCount++;
+  return true;
+}
+
+/**
+*Removes an unsent message to make room in the queue
+*@param type the type of message that needs room
+*@param priority the priority of the message that needs room. Messages
+*with higher priority are only dropped if they share its type.
+*@return true if a message was removed, false if there were no
+*unsent messages that could be dropped
+*/
+static bool drop_message(uint8_t type, uint8_t priority){
+  MessageHeader * oldest = NULL;
+  if(first_message() == NULL)return false;
+  uint16_t offset = queueHead;
+  for(int i = 0; i < queueCount; i++){
+    MessageHeader * message = message_at(offset);
+    if(!message->sending && !message->dropped){//never drop a message being sent
+      if(message->type == type){
+        oldest = message;
+        break;
+      }
+      //Otherwise, drop the oldest message with the lowest priority
+      if(message->priority <= priority && (oldest == NULL || message->priority < oldest->priority))
+        oldest = message;
+    }
+    if(i < queueCount - 1)offset = next_message_offset(offset);
+  }
+  if(oldest == NULL)return false;
+  TRACE("x %d", oldest->type);
+  count(&metrics.dropped);
+  oldest->dropped = 1;
+  droppedCount++;
+  release_dropped_messages();
+  return true;
+}
+
+/**
+*Removes unsent messages that are past their deadline
+*@return true if any messages were removed
+*/
+static bool drop_expired_messages(){
+  if(first_message() == NULL)return false;
+  time_t now = time(NULL);
+  bool expired = false;
+  uint16_t offset = queueHead;
+  for(int i = 0; i < queueCount; i++){
+    MessageHeader * message = message_at(offset);
+    if(!message->sending && !message->dropped && message->deadline != 0
+       && message->deadline <= (uint32_t) now){
+      #ifdef DEBUG_MESSAGING
+      APP_LOG(APP_LOG_LEVEL_DEBUG,"drop_expired_messages:Dropping expired message of type %d",message->type);
+      #endif
+      TRACE("x %d", message->type);
+      count(&metrics.dropped);
+      message->dropped = 1;
+      droppedCount++;
+      expired = true;
+    }
+    if(i < queueCount - 1)offset = next_message_offset(offset);
+  }
+  if(expired)release_dropped_messages();
+  return expired;
+}
+
+/**
+*Frees the space used by dropped messages at the head of the queue
+*@post the queue is empty, or its oldest message isn't dropped
+*/
+static void release_dropped_messages(){
+  MessageHeader * message;
+  while((message = first_message()) != NULL && message->dropped){
+    queueCount--;
+    droppedCount--;
+    if(queueCount == 0){
+      queueHead = queueTail = queueUsed = 0;
+      return;
+    }
+    uint16_t recordSize = RECORD_SIZE(message->size);
+    queueHead += recordSize;
+    queueUsed -= recordSize;
+  }
+}
+
+/**
+*Removes dropped messages, moving later messages back to fill the gaps
+*@post message order is unchanged, and the queue contains no dropped messages
+*/
+static void compact_queue(){
+  if(first_message() == NULL)return;
+  uint16_t read = queueHead;
+  uint16_t write = queueHead;
+  int recordCount = queueCount;
+  queueCount = 0;
+  droppedCount = 0;
+  for(int i = 0; i < recordCount; i++){
+    MessageHeader * message = message_at(read);
+    uint16_t recordSize = RECORD_SIZE(message->size);
+    uint16_t next = (i < recordCount - 1) ? next_message_offset(read) : 0;
+    if(!message->dropped){
+      if(write + recordSize > QUEUE_SIZE){//continue from the buffer start
+        if(write + sizeof(MessageHeader) <= QUEUE_SIZE) message_at(write)->size = 0;
+        write = 0;
+      }
+      if(message->sending)sendingOffset = write;
+      memmove(messageQueue + write, messageQueue + read, recordSize);
+      write += recordSize;
+      queueCount++;
+    }
+    read = next;
+  }
+  queueTail = write;
+  if(queueCount == 0)queueHead = queueTail = queueUsed = 0;
+  else if(queueTail > queueHead)queueUsed = queueTail - queueHead;
+  else queueUsed = QUEUE_SIZE - queueHead + queueTail;
+}
+
+/**
+*Registers AppMessage callbacks and opens AppMessage with the current
+*buffer sizes, using the largest possible inbox during bulk transfers
+*/
+static void open_app_message(){
+  app_message_register_inbox_received(inbox_received_callback);
+  app_message_register_inbox_dropped(inbox_dropped_callback);
+  app_message_register_outbox_failed(outbox_failed_callback);
+  app_message_register_outbox_sent(outbox_sent_callback);
+  //If there isn't enough memory, fall back to the normal inbox, then the default size
+  uint32_t inboxSizes[] = {bulkMode ? app_message_inbox_size_maximum() : inboxSize,
+                           inboxSize, DICT_SIZE};
+  AppMessageResult result = APP_MSG_OUT_OF_MEMORY;
+  for(int i = 0; i < (int)(sizeof(inboxSizes) / sizeof(inboxSizes[0])) && result != APP_MSG_OK; i++){
+    if(i > 0 && inboxSizes[i] >= openInboxSize)continue;//no smaller than the failed size
+    openInboxSize = inboxSizes[i];
+    result = app_message_open(openInboxSize, outboxSize);
+    TRACE("o %d %d %d", (int)openInboxSize, (int)outboxSize, result);
+    if(result != APP_MSG_OK){
+      APP_LOG(APP_LOG_LEVEL_ERROR,"open_app_message:Couldn't open AppMessage with inbox %d!",
+              (int)openInboxSize);
+      log_result_info(result);
+    }
+  }
+  #ifdef DEBUG_MESSAGING
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"open_app_message:Opened with inbox %d, outbox %d",
+          (int)openInboxSize,(int)outboxSize);
+  #endif
+}
+
+/**
+*Reopens AppMessage with the current buffer sizes. Reopening discards
+*the outbox, so if a message is being sent this waits until send_message
+*runs again.
+*/
+static void resize_buffers(){
+  if(!init)return;//The new sizes are used when messaging is opened
+  if(sendingMessage){
+    resizePending = true;
+    return;
+  }
+  resizePending = false;
+  app_message_deregister_callbacks();
+  open_app_message();
+}
+
+/**
+*Removes the message being sent from the queue
 */
 static void delete_message(){
   if(!init)open_messaging();
-  if(messageStack != NULL){
-    MessageStack * old = messageStack;
-    messageStack = messageStack->next;
-    free(old);
-    messageStackSize--;
+  MessageHeader * message = sending_message();
+  if(message != NULL){
+    message->dropped = 1;
+    droppedCount++;
+    sendingMessage = false;
+    release_dropped_messages();
     #ifdef DEBUG_MESSAGING
       APP_LOG(APP_LOG_LEVEL_DEBUG,"delete_message:old message deleted");
     #endif
@@ -201,9 +605,72 @@ static void delete_message(){
 *@param data: unused callback data
 */
 static void resend_message(void * data){
+  count(&metrics.retries);
   resend_timer = NULL;
+  retryScheduled = false;
   send_message();
 }
+
+/**
+*Schedules another attempt to send a message after a failure.
+*Messages that can never be sent are dropped instead.
+*@param reason the failure reason
+*/
+static void schedule_retry(AppMessageResult reason){
+  if(resend_timer != NULL){
+    app_timer_cancel(resend_timer);
+    resend_timer = NULL;
+  }
+  MessageHeader * message = sending_message();
+  if(message == NULL)return;
+  TRACE("f %d %d", message->type, reason);
+  if(reason != APP_MSG_OK)count(&metrics.failures[__builtin_ctz(reason) % METRICS_RESULTS]);
+  if(reason == APP_MSG_INVALID_ARGS || reason == APP_MSG_BUFFER_OVERFLOW){
+    APP_LOG(APP_LOG_LEVEL_ERROR,"schedule_retry:Message can't be sent, dropping it");
+    TRACE("x %d", message->type);
+    count(&metrics.dropped);
+    delete_message();
+    send_message();
+    return;
+  }
+  uint32_t delay = retry_delay(reason, message->attempts);
+  if(message->attempts < UINT8_MAX)message->attempts++;
+  #ifdef DEBUG_MESSAGING
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"schedule_retry:Retrying in %d ms",(int)delay);
+  #endif
+  resend_timer = app_timer_register(delay,resend_message,NULL);
+  retryScheduled = true;
+}
+
+/**
+*Gets how long to wait before retrying a failed message. Delays grow
+*exponentially with each attempt, and are randomly varied so retries
+*don't line up with other traffic.
+*@param reason the failure reason
+*@param attempts the number of times the message has already failed
+*@return the retry delay in milliseconds
+*/
+static uint32_t retry_delay(AppMessageResult reason, uint8_t attempts){
+  uint32_t delay;
+  switch(reason){
+    case APP_MSG_BUSY:
+    case APP_MSG_OUT_OF_MEMORY:
+      delay = RETRY_DELAY_BUSY;
+      break;
+    case APP_MSG_NOT_CONNECTED:
+    case APP_MSG_APP_NOT_RUNNING:
+    case APP_MSG_CLOSED:
+      delay = RETRY_DELAY_DISCONNECTED;
+      break;
+    default:
+      delay = RETRY_DELAY_TIMEOUT;
+  }
+  for(int i = 0; i < attempts && delay < RETRY_MAX_DELAY; i++)delay *= 2;
+  if(delay > RETRY_MAX_DELAY)delay = RETRY_MAX_DELAY;
+  uint32_t jitter = delay * RETRY_JITTER / 100;
+  delay = delay - jitter + rand() % (2 * jitter + 1);
+  return delay < RETRY_MAX_DELAY ? delay : RETRY_MAX_DELAY;
+}
   
 /**
 *Automatically called whenever a message is recieved
@@ -217,6 +684,9 @@ static void inbox_received_callback(DictionaryIterator *iterator, void *context)
   APP_LOG(APP_LOG_LEVEL_DEBUG,"inbox_received_callback:Received message content:");
   debugDictionary(iterator);
   #endif
+  metrics.bytesReceived += dict_size(iterator);
+  count(&metrics.messagesReceived);
+  TRACE("r %d", (int)dict_size(iterator));
   //pass message to the message handler
   if(inbox_handler != NULL)inbox_handler(iterator);  
 }
@@ -231,6 +701,8 @@ static void inbox_dropped_callback(AppMessageResult reason, void *context) {
   APP_LOG(APP_LOG_LEVEL_ERROR, "inbox_dropped_callback:Message dropped");
   log_result_info(reason);
   #endif
+  TRACE("i %d", reason);
+  if(reason != APP_MSG_OK)count(&metrics.inboxDropped[__builtin_ctz(reason) % METRICS_RESULTS]);
 }
 
 /**
@@ -238,17 +710,14 @@ static void inbox_dropped_callback(AppMessageResult reason, void *context) {
 *@param iterator data from the failed send
 *@param reason the failure reason
 *@param context is required but unused
-*@post the message is re-sent
+*@post the message is re-sent after a delay, or dropped if it can't be sent
 */
 static void outbox_failed_callback(DictionaryIterator *iterator, AppMessageResult reason, void *context) {
   #ifdef DEBUG_MESSAGING
   APP_LOG(APP_LOG_LEVEL_ERROR, "outbox_failed_callback:Outbox send failed");
   log_result_info(reason);
   #endif
-  //reset timer to give Android more time to receive the message before re-sending
-  if(resend_timer != NULL){
-    app_timer_reschedule(resend_timer, RESEND_TIME);
-  }
+  schedule_retry(reason);
 }
 
 /**
@@ -263,6 +732,10 @@ static void outbox_sent_callback(DictionaryIterator *iterator, void *context) {
   #endif
   app_timer_cancel(resend_timer);
   resend_timer = NULL;//cancel re-send timer
+  MessageHeader * message = sending_message();
+  if(message != NULL)TRACE("a %d", message->type);
+  if(message != NULL && outbox_sent_handler != NULL)
+    outbox_sent_handler((uint8_t *)(message + 1), message->size);
   delete_message();//delete successfully sent message
   sendingMessage = false;
   send_message();//send the next message in the queue, if there is one
@@ -324,3 +797,34 @@ static void log_result_info(AppMessageResult result){
   }
   #endif
 }
+
+/**
+*Increments a metrics counter, stopping at its maximum value
+*@param counter the counter to increment
+*/
+static void count(uint16_t * counter){
+  if(*counter < UINT16_MAX)(*counter)++;
+}
+
+/**
+*Writes a little-endian 16 bit value
+*@param buffer where the value is written
+*@param value the value to write
+*@return the position after the written value
+*/
+static uint8_t * write_u16(uint8_t * buffer, uint16_t value){
+  buffer[0] = value & 0xFF;
+  buffer[1] = value >> 8;
+  return buffer + 2;
+}
+
+/**
+*Writes a little-endian 32 bit value
+*@param buffer where the value is written
+*@param value the value to write
+*@return the position after the written value
+*/
+static uint8_t * write_u32(uint8_t * buffer, uint32_t value){
+  buffer = write_u16(buffer, value & 0xFFFF);
+  return write_u16(buffer, value >> 16);
+}
@@ -6,8 +6,69 @@
 #pragma once
 #include <pebble.h>
 
-#define DICT_SIZE 256//AppMessage dictionary size
+//#define MESSAGING_TRACE //Uncomment to log a compact trace of all message traffic
+
+//----------MESSAGE TRACING----------
+//With MESSAGING_TRACE defined, every message event is logged as one line:
+//"TRACE <seconds into the day>.<ms> <event> <values>", with these events:
+//  o inboxSize outboxSize result: AppMessage opened, with an AppMessageResult
+//  q type priority size count: message queued, with the new queue count
+//  s type attempts bytes: message sent
+//  a type: message acknowledged
+//  f type result: send failed with an AppMessageResult
+//  x type: unsent message dropped
+//  r bytes: message received
+//  i result: incoming message dropped with an AppMessageResult
+//  R code: received message code, logged by message_handler
+//  Q types: update request bitmask sent, logged by message_handler
+//Traces can be pulled from app logs and replayed against a stand-in companion
+//app to compare protocol changes offline.
+#ifdef MESSAGING_TRACE
+#define TRACE(format, ...) do{ \
+    time_t traceSeconds; \
+    uint16_t traceMs; \
+    time_ms(&traceSeconds, &traceMs); \
+    APP_LOG(APP_LOG_LEVEL_INFO, "TRACE %d.%03d " format, \
+            (int)(traceSeconds % 86400), traceMs, ##__VA_ARGS__); \
+  }while(0)
+#else
+#define TRACE(...) do{}while(0)
+#endif
+
+//----------MESSAGING METRICS----------
+//Counters are kept from launch, and written by write_messaging_metrics as
+//little-endian values in this order:
+//  uint8 METRICS_VERSION
+//  uint32 bytes sent, uint32 bytes received
+//  uint16 messages sent, messages received, retries, unsent messages dropped,
+//         queue high-water mark in bytes
+//  uint16[METRICS_RESULTS] send failures, indexed by the bit set in the AppMessageResult
+//  uint16[METRICS_RESULTS] incoming messages dropped, indexed the same way
+//  uint16[LATENCY_TYPES][NUM_LATENCY_BUCKETS] response latency counts, by message type
+//Latency buckets hold responses within 250, 500, 1000, 2500 and 10000
+//milliseconds, then any slower. 16 bit counters stop at UINT16_MAX.
+#define METRICS_VERSION 2
+#define METRICS_RESULTS 16 //AppMessageResult values are single bits, up to bit 15
+#define LATENCY_TYPES 4 //Message types with latency histograms
+#define NUM_LATENCY_BUCKETS 6
+#define METRICS_SIZE (1 + 2 * 4 + 5 * 2 + 2 * METRICS_RESULTS * 2 \
+  + LATENCY_TYPES * NUM_LATENCY_BUCKETS * 2)
+
+#define DICT_SIZE 256//Default AppMessage buffer size, used until set_buffer_sizes is called
 typedef void (* InboxHandler)(DictionaryIterator *iterator);
+/**
+*Writes a queued message straight into the AppMessage outbox
+*@param outbox the outbox dictionary iterator
+*@param data the message descriptor passed to add_message
+*@param size the descriptor size in bytes
+*/
+typedef void (* OutboxWriter)(DictionaryIterator *outbox, const uint8_t * data, uint16_t size);
+/**
+*Notified when a queued message is acknowledged by the phone
+*@param data the message descriptor passed to add_message
+*@param size the descriptor size in bytes
+*/
+typedef void (* OutboxSentHandler)(const uint8_t * data, uint16_t size);
 
 /**
 *Initialize messaging and open AppMessage
@@ -26,10 +87,84 @@ void close_messaging();
 */
 void register_inbox_handler(InboxHandler handler);
 
+/**
+*Registers the function that turns queued message descriptors
+*into outgoing dictionaries
+*@param writer the message writing function
+*/
+void register_outbox_writer(OutboxWriter writer);
+
+/**
+*Registers a function to notify whenever a message is acknowledged
+*@param handler the acknowledgement handling function
+*/
+void register_outbox_sent_handler(OutboxSentHandler handler);
+
+/**
+*Sets the AppMessage inbox and outbox sizes. If messaging is already
+*open, AppMessage is reopened with the new sizes once no message is
+*being sent.
+*@param inboxSize inbox size in bytes, used outside of bulk transfers
+*@param outboxSize outbox size in bytes
+*/
+void set_buffer_sizes(uint32_t inboxSize, uint32_t outboxSize);
+
+/**
+*Starts a bulk transfer, reopening AppMessage with the largest
+*possible inbox once no message is being sent
+*/
+void begin_bulk_transfer();
+
+/**
+*Ends a bulk transfer, shrinking the inbox back to its normal size
+*once no message is being sent
+*/
+void end_bulk_transfer();
+
+/**
+*Gets the size of the open AppMessage inbox
+*@return the inbox size in bytes
+*/
+uint32_t get_inbox_size();
+
 /**
 *Adds a message to the outbox queue, to
-*be sent soon
-*@param dictBuf a dictionary message buffer to
-*be copied
+*be sent soon. The registered OutboxWriter builds the
+*outgoing dictionary from the descriptor when the message is sent.
+*@param data a compact message descriptor to be copied
+*@param size the descriptor size in bytes
+*@param type the message type. If the queue is full, the oldest queued
+*message of the same type is dropped to make room.
+*@param priority the message priority. Queued messages are sent highest
+*priority first, and oldest first within a priority.
+*@param lifetime seconds before the message is dropped if it still hasn't
+*been delivered, or 0 to keep retrying indefinitely
+*/
+void add_message(const uint8_t * data, uint16_t size, uint8_t type, uint8_t priority, uint16_t lifetime);
+
+/**
+*Gets a millisecond timestamp for measuring response latency. The
+*timestamp wraps around, so only differences between timestamps are meaningful.
+*@return the current time in milliseconds
+*/
+uint32_t messaging_time_ms();
+
+/**
+*Records how long a response took to arrive
+*@param type the message type, below LATENCY_TYPES
+*@param milliseconds milliseconds between request and response
+*/
+void record_response_latency(uint8_t type, uint32_t milliseconds);
+
+/**
+*Writes messaging metrics into a buffer, as described above
+*@param buffer a buffer of at least METRICS_SIZE bytes
+*@return the number of bytes written
+*/
+uint16_t write_messaging_metrics(uint8_t * buffer);
+
+/**
+*Retries queued messages immediately, skipping any retry delay.
+*Call this when the connection to the phone returns.
 */
-void add_message(uint8_t dictBuf[DICT_SIZE]);
+void resume_messaging();
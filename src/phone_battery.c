@@ -0,0 +1,258 @@
+#include <pebble.h>
+#include "phone_battery.h"
+#include "display_handler.h"
+#include "storage_keys.h"
+
+//----------LOCAL VALUE DEFINITIONS----------
+//#define DEBUG_PHONE_BATTERY //uncomment to enable phone battery debug logging
+#define PHONE_BATTERY_DATA_VERSION 1 //Saved reading format, change whenever phoneBatteryData changes
+#define SAMPLE_WINDOW 21600 //Readings this many seconds older than the newest are dropped
+#define MIN_FIT_SPAN 900 //Seconds readings must span before a rate is fitted to them
+#define MIN_REFRESH_INTERVAL 900 //Shortest time between readings requested by the prediction(seconds)
+//Prediction values are in thousandths of a percent, and rates in thousandths
+//of a percent per hour
+#define MILLI_PERCENT_FULL 100000
+#define READING_ERROR 1000 //Readings are rounded to whole percentages
+#define RATE_DRIFT 2000 //How far the real rate may have moved from the fitted rate
+#define MAX_UNCERTAINTY 5000 //Prediction uncertainty that needs a new reading
+#define SAVE_DELAY 3600000 //Milliseconds to collect new readings before saving them
+
+//----------PHONE BATTERY DATA STRUCTURES----------
+//One phone battery reading
+struct batterySample{
+  uint32_t time;//time the reading was received
+  uint8_t percent;//phone battery percentage
+};
+
+//Saved readings, written to persistent storage as a single block
+struct phoneBatteryData{
+  uint8_t version;//saved data format, equal to PHONE_BATTERY_DATA_VERSION
+  uint8_t count;//number of readings in use
+  bool charging;//charging state shared by every reading
+  struct batterySample samples[MAX_BATTERY_SAMPLES];//readings, oldest first
+};
+
+//Rate fitted to the saved readings
+struct batteryModel{
+  bool valid;//true if enough readings have been fitted to predict
+  time_t anchorTime;//mean reading time
+  int32_t anchor;//fitted percentage at anchorTime
+  int32_t rate;//fitted change per hour
+  int32_t maxResidual;//largest distance between a reading and the fitted line
+  int32_t rateError;//estimated error of the fitted rate, per hour
+};
+
+//----------LOCAL VARIABLES----------
+static struct phoneBatteryData readings = {.version = PHONE_BATTERY_DATA_VERSION};
+static struct batteryModel model = {0};
+static int shownPercent = -1;//Displayed percentage, or -1 if none is shown
+static bool shownCharging = false;//Displayed charging state
+static bool shownDisconnected = false;//True if the phone is shown as disconnected
+static bool readingsDirty = false;//true if readings changed since the last save
+static AppTimer * saveTimer = NULL;//Timer for saving changed readings
+
+//----------STATIC FUNCTION DECLARATIONS----------
+static void fit_model();
+  //Fits a charge rate to the saved readings
+static int predict_percent(time_t now);
+  //Gets the predicted phone battery percentage at a given time
+static void show_percent(int percent, bool charging);
+  //Displays a phone battery percentage if it isn't already shown
+static void schedule_save();
+  //Saves readings after SAVE_DELAY, unless a save is already scheduled
+static void save_timer_callback(void * data);
+  //Saves changed readings when the save timer runs out
+static void save_readings();
+  //Saves changed readings to persistent storage
+
+//----------PUBLIC FUNCTIONS----------
+//Loads saved phone battery readings
+void phone_battery_init(){
+  if(persist_exists(PERSIST_KEY_PHONE_BATTERY)){
+    struct phoneBatteryData saved;
+    persist_read_data(PERSIST_KEY_PHONE_BATTERY, &saved, sizeof(saved));
+    if(saved.version == PHONE_BATTERY_DATA_VERSION && saved.count <= MAX_BATTERY_SAMPLES)
+      readings = saved;
+  }
+  fit_model();
+  shownPercent = -1;
+}
+
+//Saves any unsaved phone battery readings
+void phone_battery_deinit(){
+  save_readings();
+}
+
+//Records and displays a new phone battery reading
+void add_phone_battery_reading(time_t time, int percent, bool charging){
+  if(percent < 0)percent = 0;
+  if(percent > 100)percent = 100;
+  //Rates while charging and discharging have nothing in common
+  if(charging != readings.charging)readings.count = 0;
+  readings.charging = charging;
+  //Drop the oldest reading to make room, along with any outside the sample window
+  int dropped = readings.count == MAX_BATTERY_SAMPLES ? 1 : 0;
+  while(dropped < readings.count && time - readings.samples[dropped].time > SAMPLE_WINDOW)dropped++;
+  if(dropped > 0){
+    readings.count -= dropped;
+    memmove(readings.samples, readings.samples + dropped, readings.count * sizeof(struct batterySample));
+  }
+  readings.samples[readings.count].time = time;
+  readings.samples[readings.count].percent = percent;
+  readings.count++;
+  readingsDirty = true;
+  schedule_save();
+  fit_model();
+  show_percent(percent, charging);
+}
+
+//Discards all phone battery readings
+void clear_phone_battery(){
+  //The display no longer shows a reading, so the next one must be drawn
+  shownPercent = -1;
+  if(readings.count == 0)return;
+  readings.count = 0;
+  readingsDirty = true;
+  schedule_save();
+  model.valid = false;
+}
+
+//Displays the predicted phone battery percentage
+void update_phone_battery(time_t now, bool connected){
+  if(!connected){
+    if(shownDisconnected)return;
+    update_text("X",TEXT_PHONE_BATTERY);//phone is disconnected, set phone battery to X
+    shownDisconnected = true;
+    shownPercent = -1;
+    return;
+  }
+  shownDisconnected = false;
+  if(!model.valid)return;
+  show_percent(predict_percent(now), readings.charging);
+}
+
+//Gets when the phone battery prediction stops being reliable
+time_t get_phone_battery_refresh_time(){
+  if(!model.valid)return 0;
+  time_t newest = readings.samples[readings.count - 1].time;
+  //Uncertainty starts at the reading and fit error, and grows with the rate error
+  int64_t margin = MAX_UNCERTAINTY - READING_ERROR - model.maxResidual;
+  int64_t elapsed = margin > 0 ? margin * 3600 / (model.rateError + RATE_DRIFT) : 0;
+  time_t refresh = newest + elapsed;
+  //The charging state changes once the battery is predicted full or empty
+  if(model.rate != 0){
+    int64_t edge = model.rate > 0 ? MILLI_PERCENT_FULL : 0;
+    time_t edgeTime = model.anchorTime + (edge - model.anchor) * 3600 / model.rate;
+    if(edgeTime < refresh)refresh = edgeTime;
+  }
+  if(refresh < newest + MIN_REFRESH_INTERVAL)refresh = newest + MIN_REFRESH_INTERVAL;
+  return refresh;
+}
+
+//----------STATIC FUNCTIONS----------
+
+/**
+*Fits a charge rate to the saved readings with a least squares line
+*/
+static void fit_model(){
+  model.valid = false;
+  if(readings.count < 2)return;
+  time_t first = readings.samples[0].time;
+  int span = readings.samples[readings.count - 1].time - first;
+  if(span < MIN_FIT_SPAN)return;
+  int64_t sumTime = 0;
+  int64_t sumPercent = 0;
+  for(int i = 0; i < readings.count; i++){
+    sumTime += readings.samples[i].time - first;
+    sumPercent += readings.samples[i].percent * 1000;
+  }
+  int64_t meanTime = sumTime / readings.count;
+  int64_t meanPercent = sumPercent / readings.count;
+  int64_t sxx = 0;
+  int64_t sxy = 0;
+  for(int i = 0; i < readings.count; i++){
+    int64_t dt = readings.samples[i].time - first - meanTime;
+    sxx += dt * dt;
+    sxy += dt * (readings.samples[i].percent * 1000 - meanPercent);
+  }
+  if(sxx == 0)return;
+  model.anchorTime = first + meanTime;
+  model.anchor = meanPercent;
+  model.rate = sxy * 3600 / sxx;
+  model.maxResidual = 0;
+  for(int i = 0; i < readings.count; i++){
+    int64_t fitted = model.anchor
+      + (int64_t) model.rate * ((time_t) readings.samples[i].time - model.anchorTime) / 3600;
+    int32_t residual = readings.samples[i].percent * 1000 - fitted;
+    if(residual < 0)residual = -residual;
+    if(residual > model.maxResidual)model.maxResidual = residual;
+  }
+  //A line moved by the largest residual at both ends of the span
+  model.rateError = (int64_t) model.maxResidual * 2 * 3600 / span;
+  model.valid = true;
+  #ifdef DEBUG_PHONE_BATTERY
+  APP_LOG(APP_LOG_LEVEL_DEBUG,"fit_model:rate %d, error %d, residual %d",
+          (int)model.rate,(int)model.rateError,(int)model.maxResidual);
+  #endif
+}
+
+/**
+*Gets the predicted phone battery percentage at a given time
+*@param now the time to predict
+*@return the fitted percentage, between 0 and 100
+*@pre model.valid is true
+*/
+static int predict_percent(time_t now){
+  int64_t predicted = model.anchor + (int64_t) model.rate * (now - model.anchorTime) / 3600;
+  if(predicted < 0)predicted = 0;
+  if(predicted > MILLI_PERCENT_FULL)predicted = MILLI_PERCENT_FULL;
+  return (predicted + 500) / 1000;
+}
+
+/**
+*Displays a phone battery percentage if it isn't already shown
+*@param percent the battery percentage
+*@param charging true if the phone is charging
+*/
+static void show_percent(int percent, bool charging){
+  if(percent == shownPercent && charging == shownCharging)return;
+  shownPercent = percent;
+  shownCharging = charging;
+  shownDisconnected = false;
+  char batteryBuf[6];
+  snprintf(batteryBuf, sizeof(batteryBuf), "%d%%", percent);
+  if(charging)strcat(batteryBuf, "+");
+  update_text(batteryBuf, TEXT_PHONE_BATTERY);
+}
+
+/**
+*Saves readings after SAVE_DELAY, unless a save is already scheduled
+*Readings added before the timer runs out are saved together
+*/
+static void schedule_save(){
+  if(saveTimer == NULL && readingsDirty){
+    saveTimer = app_timer_register(SAVE_DELAY, save_timer_callback, NULL);
+  }
+}
+
+/**
+*Saves changed readings when the save timer runs out
+*@param data unused callback data
+*/
+static void save_timer_callback(void * data){
+  saveTimer = NULL;
+  save_readings();
+}
+
+/**
+*Saves changed readings to persistent storage
+*/
+static void save_readings(){
+  if(saveTimer != NULL){
+    app_timer_cancel(saveTimer);
+    saveTimer = NULL;
+  }
+  if(!readingsDirty)return;
+  persist_write_data(PERSIST_KEY_PHONE_BATTERY, &readings, sizeof(readings));
+  readingsDirty = false;
+}
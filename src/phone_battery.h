@@ -0,0 +1,53 @@
+/**
+*@File phone_battery.h
+*Keeps recent phone battery readings, and fits the phone's charge
+*or discharge rate to them so the displayed phone battery can be
+*extrapolated between readings
+*/
+
+#pragma once
+#include <pebble.h>
+
+#define MAX_BATTERY_SAMPLES 6 //Number of phone battery readings kept for fitting
+
+/**
+*Loads saved phone battery readings
+*/
+void phone_battery_init();
+
+/**
+*Saves any phone battery readings not yet written to persistent storage
+*/
+void phone_battery_deinit();
+
+/**
+*Records and displays a new phone battery reading. Readings with a
+*different charging state than the last one replace all saved readings.
+*@param time the time the reading was received
+*@param percent the phone battery percentage
+*@param charging true if the phone is charging
+*/
+void add_phone_battery_reading(time_t time, int percent, bool charging);
+
+/**
+*Discards all phone battery readings, so nothing is predicted
+*until the next reading
+*/
+void clear_phone_battery();
+
+/**
+*Displays the predicted phone battery percentage, if it changed since
+*it was last shown
+*@param now the current time
+*@param connected true if the phone is connected. The phone is shown
+*as disconnected otherwise.
+*/
+void update_phone_battery(time_t now, bool connected);
+
+/**
+*Gets when the phone battery prediction stops being reliable, and
+*a new reading should be requested
+*@return the time a new reading is needed, or 0 if there aren't enough
+*readings to make a prediction
+*/
+time_t get_phone_battery_refresh_time();
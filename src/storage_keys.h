@@ -13,6 +13,15 @@ enum{
   PERSIST_KEY_FUTURE_EVENT_FORMAT,//int: FutureEventFormat value
   PERSIST_KEY_COMPANION_APP_CONTACTED,//int: 1 if the companion app has been found
   PERSIST_KEY_THEME,//int: display theme choice
+  PERSIST_KEY_REMINDER_TIMES,//data: time_t array of scheduled event reminder times
+  PERSIST_KEY_BUSY_SLOTS,//data: day start time_t followed by the day's busy slot bitset
+  PERSIST_KEY_FORECAST,//data: forecastData structure from forecast.c
+  PERSIST_KEY_INTERVAL_SCALES,//data: uint16_t update interval scales from message_handler.c
+  PERSIST_KEY_QUIET_HOURS_START,//int: minutes after midnight that quiet hours begin
+  PERSIST_KEY_QUIET_HOURS_END,//int: minutes after midnight that quiet hours end
+  PERSIST_KEY_UPDATE_BOUNDS,//data: CodecUpdateBounds array from message_handler.c
+  PERSIST_KEY_CHANGE_RATES,//data: uint16_t update type change rates from message_handler.c
+  PERSIST_KEY_PHONE_BATTERY,//data: phoneBatteryData structure from phone_battery.c
   
   /**
   *string: first display string
@@ -44,6 +53,13 @@ enum{
   */
   PERSIST_KEY_COLORS_BEGIN = 70,
     
+  /**
+  *int: First update priority
+  *This begins a series of keys holding message priorities for all update types
+  *Update types are defined in order in messaging.h
+  */
+  PERSIST_KEY_UPDATE_PRIORITIES_BEGIN = 120,
+    
   /**
   *data: EventStruct data structure from events.c,
   *saved across as many sequential keys as needed
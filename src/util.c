@@ -106,4 +106,38 @@ long stol(char * str,int strlen){
   return val;
 }
 
+/**
+*Given a color hex string, returns a corresponding GColor
+*@param string a cstring set to a valid six digit hex color value
+*@return the correct GColor
+*/
+GColor hex_string_to_gcolor(char * string){
+  int color,base,i;
+  color = 0;
+  base = 1;
+  for(i=1;i<=6;i++){
+      char iChar = string[6-i];
+      if(('a' <= iChar) && (iChar <= 'f')) color += ((int) iChar - 'a' + 10) * base;
+      else if(('A' <= iChar) && (iChar <= 'F')) color += ((int) iChar - 'A' + 10) * base;
+      else if(('0' <= iChar) && (iChar <= '9')) color += ((int) iChar - '0') * base;  
+      base *= 16;
+    }
+  GColor gcolor = GColorFromHEX(color);
+  return gcolor;
+}
 
+/**
+*Adds data to a FNV-1a hash
+*@param hash the hash value so far, or FNV_OFFSET_BASIS to start a new hash
+*@param data the bytes to add
+*@param size number of bytes to add
+*@return the updated hash value
+*/
+uint32_t hash_bytes(uint32_t hash, const void * data, size_t size){
+  const uint8_t * bytes = data;
+  for(size_t i = 0; i < size; i++){
+    hash ^= bytes[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
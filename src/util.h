@@ -6,6 +6,9 @@
 *type conversion functions, debug functions, etc.
 */
 
+#define FNV_OFFSET_BASIS 2166136261u //32 bit FNV-1a initial hash value
+#define FNV_PRIME 16777619u //32 bit FNV-1a multiplier
+
 /**
 *Copies the pebble's remaining battery percentage into a buffer
 *@param buffer a buffer of at least 6 bytes
@@ -58,6 +61,22 @@ char * malloc_strcpy(char * dest, char * src);
 */
 char * malloc_set_text(TextLayer * textLayer,char * oldString, char * src);
 
+/**
+*Given a color hex string, returns a corresponding GColor
+*@param string a cstring set to a valid six digit hex color value
+*@return the correct GColor
+*/
+GColor hex_string_to_gcolor(char * string);
+
+/**
+*Adds data to a FNV-1a hash
+*@param hash the hash value so far, or FNV_OFFSET_BASIS to start a new hash
+*@param data the bytes to add
+*@param size number of bytes to add
+*@return the updated hash value
+*/
+uint32_t hash_bytes(uint32_t hash, const void * data, size_t size);
+
 /**
 *Returns the long value of a char string
 *@param str the string